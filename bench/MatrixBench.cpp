@@ -0,0 +1,108 @@
+#include "Matrices.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+using namespace Matrices;
+
+// Benchmark of Matrices::operator* on square matrices from 2x2 up to 2048x2048,
+// against the textbook i-j-k loop it replaced
+//   usage:  matrix_bench.out [--naive-max N]
+// The textbook loop is only timed up to N (1024 by default), above that it takes minutes
+
+typedef chrono::steady_clock Clock;
+
+// The original implementation: i-j-k over bounds-checked element access
+Matrix naiveMultiply(const Matrix& a, const Matrix& b)
+{
+	Matrix out(a.getRows(), b.getCols());
+	for (int i = 0; i < a.getRows(); i++)
+	{
+		for (int j = 0; j < b.getCols(); j++)
+		{
+			double total = 0.0;
+			for (int k = 0; k < a.getCols(); k++)
+			{
+				total += a(i, k) * b(k, j);
+			}
+			out(i, j) = total;
+		}
+	}
+	return out;
+}
+
+Matrix randomMatrix(int n)
+{
+	Matrix m(n, n);
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			m(i, j) = (double)rand() / RAND_MAX - 0.5;
+		}
+	}
+	return m;
+}
+
+// Average seconds per call of f, repeating until at least 0.2 s have passed
+template <typename F>
+double timeIt(F f)
+{
+	int reps = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0;
+	do
+	{
+		f();
+		reps++;
+		elapsed = chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < 0.2);
+	return elapsed / reps;
+}
+
+int main(int argc, char* argv[])
+{
+	int naiveMax = 1024;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--naive-max") == 0 && i + 1 < argc) naiveMax = atoi(argv[++i]);
+	}
+
+	cout << setw(6) << "n" << setw(14) << "naive ms" << setw(14) << "operator* ms"
+		<< setw(12) << "GFLOP/s" << setw(10) << "speedup" << setw(12) << "max error" << endl;
+
+	for (int n = 2; n <= 2048; n *= 2)
+	{
+		Matrix a = randomMatrix(n);
+		Matrix b = randomMatrix(n);
+		double flops = 2.0 * n * n * n;
+
+		Matrix c(1, 1);
+		double fast = timeIt([&]() { c = a * b; });
+
+		cout << setw(6) << n;
+		if (n <= naiveMax)
+		{
+			Matrix reference(1, 1);
+			double naive = timeIt([&]() { reference = naiveMultiply(a, b); });
+
+			// blocking changes the order of the sums, so compare with a tolerance rather than exactly
+			double error = 0;
+			for (int i = 0; i < n; i++)
+			{
+				for (int j = 0; j < n; j++)
+				{
+					error = max(error, fabs(c(i, j) - reference(i, j)));
+				}
+			}
+			cout << setw(14) << naive * 1000 << setw(14) << fast * 1000 << setw(12) << flops / fast / 1e9
+				<< setw(9) << naive / fast << "x" << setw(12) << error << endl;
+		}
+		else
+		{
+			cout << setw(14) << "-" << setw(14) << fast * 1000 << setw(12) << flops / fast / 1e9
+				<< setw(10) << "-" << setw(12) << "-" << endl;
+		}
+	}
+	return 0;
+}
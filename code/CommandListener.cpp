@@ -0,0 +1,240 @@
+#include "CommandListener.h"
+#include <iostream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+// How long a reader blocks in poll() before checking whether it should stop
+const int POLL_MS = 100;
+
+CommandListener::CommandListener(CommandQueue& queue) : m_queue(queue)
+{
+	m_running = true;
+	m_rejected = 0;
+	m_listenFd = -1;
+}
+
+CommandListener::~CommandListener()
+{
+	stop();
+}
+
+void CommandListener::handleLine(const char* begin, const char* end)
+{
+	// ignore blank lines and comments
+	const char* p = begin;
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	if (p == end || *p == '#') return;
+
+	Command cmd;
+	if (!parseCommand(p, end, cmd))
+	{
+		m_rejected.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	// the simulation drains the queue once per frame, wait for room rather than drop
+	// Sleep until the next drain instead of spinning, so a full queue doesn't keep readers on every core
+	for (;;)
+	{
+		size_t seen = m_queue.drains();
+		if (m_queue.push(cmd) || !m_running) return;
+		m_queue.waitForDrain(seen, POLL_MS);
+	}
+}
+
+#ifndef _WIN32
+
+void CommandListener::listenStdin()
+{
+	m_stdinThread = thread(&CommandListener::readLoop, this, STDIN_FILENO, true, nullptr);
+}
+
+bool CommandListener::listenSocket(const string& path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+	{
+		cerr << "Socket path too long: " << path << endl;
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+
+	// remove a stale socket left behind by a previous run, but never anything else at that path
+	struct stat existing;
+	if (lstat(path.c_str(), &existing) == 0)
+	{
+		if (!S_ISSOCK(existing.st_mode))
+		{
+			cerr << path << " exists and is not a socket, not listening on it" << endl;
+			return false;
+		}
+		unlink(path.c_str());
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return false;
+	}
+
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+	{
+		perror("bind/listen");
+		close(fd);
+		return false;
+	}
+
+	m_listenFd = fd;
+	m_socketPath = path;
+	m_threads.emplace_back(&CommandListener::acceptLoop, this);
+	return true;
+}
+
+void CommandListener::stop()
+{
+	m_running = false;
+
+	if (m_stdinThread.joinable()) m_stdinThread.join();
+	for (thread& t : m_threads)
+	{
+		if (t.joinable()) t.join();
+	}
+	m_threads.clear();
+
+	if (m_listenFd >= 0)
+	{
+		close(m_listenFd);
+		m_listenFd = -1;
+		unlink(m_socketPath.c_str());
+	}
+}
+
+void CommandListener::acceptLoop()
+{
+	// list nodes don't move, so each reader can flag its own node when it is done
+	list<Client> clients;
+	while (m_running)
+	{
+		// join readers whose producer hung up, so clients that reconnect per batch don't pile up threads
+		for (list<Client>::iterator it = clients.begin(); it != clients.end();)
+		{
+			if (it->done)
+			{
+				it->reader.join();
+				it = clients.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+
+		pollfd pfd = { m_listenFd, POLLIN, 0 };
+		if (poll(&pfd, 1, POLL_MS) <= 0) continue;
+
+		int fd = accept(m_listenFd, nullptr, nullptr);
+		if (fd < 0) continue;
+
+		// one reader per producer, they all feed the same queue
+		clients.emplace_back();
+		Client& client = clients.back();
+		client.reader = thread(&CommandListener::readLoop, this, fd, false, &client.done);
+	}
+	for (Client& client : clients) client.reader.join();
+}
+
+void CommandListener::readLoop(int fd, bool isStdin, atomic<bool>* done)
+{
+	// read in large blocks and split lines in place, a partial line is carried to the next read
+	vector<char> buffer(1 << 16);
+	size_t used = 0;
+
+	while (m_running)
+	{
+		pollfd pfd = { fd, POLLIN, 0 };
+		int ready = poll(&pfd, 1, POLL_MS);
+		if (ready == 0) continue;
+		if (ready < 0) break;
+
+		ssize_t n = read(fd, buffer.data() + used, buffer.size() - used);
+		if (n <= 0) break;
+		used += n;
+
+		char* start = buffer.data();
+		char* end = buffer.data() + used;
+		for (char* p = start; p < end; p++)
+		{
+			if (*p == '\n')
+			{
+				handleLine(start, p);
+				start = p + 1;
+			}
+		}
+
+		used = end - start;
+		if (used == buffer.size())
+		{
+			// a single line filled the whole buffer, it cannot be a valid command
+			m_rejected.fetch_add(1, memory_order_relaxed);
+			used = 0;
+		}
+		else
+		{
+			memmove(buffer.data(), start, used);
+		}
+	}
+
+	// the producer hung up without a trailing newline
+	if (used > 0) handleLine(buffer.data(), buffer.data() + used);
+
+	if (!isStdin) close(fd);
+	if (done) *done = true;
+}
+
+#else
+
+void CommandListener::listenStdin()
+{
+	// There is no portable way to interrupt a console read, so stop() waits for this thread
+	// to finish its current line (or for end of input) before the listener goes away
+	m_stdinThread = thread([this]()
+	{
+		string line;
+		while (m_running && getline(cin, line))
+		{
+			handleLine(line.data(), line.data() + line.size());
+		}
+	});
+}
+
+bool CommandListener::listenSocket(const string& path)
+{
+	cerr << "UNIX-domain sockets are not supported on this platform, ignoring " << path << endl;
+	return false;
+}
+
+void CommandListener::stop()
+{
+	m_running = false;
+	if (m_stdinThread.joinable()) m_stdinThread.join();
+}
+
+void CommandListener::acceptLoop()
+{
+}
+
+void CommandListener::readLoop(int, bool, atomic<bool>*)
+{
+}
+
+#endif
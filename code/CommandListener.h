@@ -0,0 +1,59 @@
+#pragma once
+#include "CommandQueue.h"
+#include <atomic>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+///Reads text commands (see parseCommand) from stdin or a local
+///UNIX-domain socket on background threads and pushes them into a
+///CommandQueue.  When the queue is full the reader waits for the
+///simulation to drain it, so external producers get back-pressure
+///instead of silently losing commands.
+class CommandListener
+{
+public:
+	explicit CommandListener(CommandQueue& queue);
+	~CommandListener();
+
+	CommandListener(const CommandListener&) = delete;
+	CommandListener& operator=(const CommandListener&) = delete;
+
+	///Start reading commands from standard input
+	void listenStdin();
+
+	///Start accepting connections on a UNIX-domain socket at path.
+	///Each client gets its own reader thread.  Returns false if the
+	///socket could not be created (or on platforms without them).
+	bool listenSocket(const string& path);
+
+	///Stop every reader thread and remove the socket file.
+	///On Windows the stdin reader can't be interrupted, so this blocks
+	///until it reads its next line or reaches the end of input.
+	void stop();
+
+	///Number of lines that could not be parsed
+	uint64_t rejected() const { return m_rejected.load(memory_order_relaxed); }
+
+private:
+	// A socket reader thread, and whether it has finished and can be joined
+	struct Client
+	{
+		thread reader;
+		atomic<bool> done{ false };
+	};
+
+	CommandQueue& m_queue;
+	atomic<bool> m_running;
+	atomic<uint64_t> m_rejected;
+	vector<thread> m_threads;
+	thread m_stdinThread;
+	string m_socketPath;
+	int m_listenFd;
+
+	void acceptLoop();
+	void readLoop(int fd, bool isStdin, atomic<bool>* done);
+	void handleLine(const char* begin, const char* end);
+};
@@ -0,0 +1,185 @@
+#include "CommandQueue.h"
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Skip spaces and tabs, return the start of the next token
+	const char* skipSpace(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+		return p;
+	}
+
+	// Return the end of the token starting at p
+	const char* tokenEnd(const char* p, const char* end)
+	{
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+		return p;
+	}
+
+	bool tokenIs(const char* p, const char* e, const char* word)
+	{
+		size_t len = strlen(word);
+		return (size_t)(e - p) == len && memcmp(p, word, len) == 0;
+	}
+
+	// Parse the next whitespace separated number, advancing p past it
+	template <typename T>
+	bool nextNumber(const char*& p, const char* end, T& out)
+	{
+		p = skipSpace(p, end);
+		const char* e = tokenEnd(p, end);
+		if (p == e) return false;
+		from_chars_result result = from_chars(p, e, out);
+		if (result.ec != errc() || result.ptr != e) return false;
+		p = e;
+		return true;
+	}
+}
+
+bool parseCommand(const char* begin, const char* end, Command& cmd)
+{
+	cmd = Command();
+
+	const char* p = skipSpace(begin, end);
+	const char* e = tokenEnd(p, end);
+
+	if (tokenIs(p, e, "spawn"))
+	{
+		cmd.type = CommandType::Spawn;
+		p = e;
+		if (!nextNumber(p, end, cmd.x) || !nextNumber(p, end, cmd.y)) return false;
+
+		// count and number of points are optional
+		if (skipSpace(p, end) != end && !nextNumber(p, end, cmd.count)) return false;
+		if (skipSpace(p, end) != end && !nextNumber(p, end, cmd.numPoints)) return false;
+		// an explicit count of 0 would mean a random count, which only clicks ask for
+		return cmd.count > 0 && commandInRange(cmd) && skipSpace(p, end) == end;
+	}
+	if (tokenIs(p, e, "clear"))
+	{
+		cmd.type = CommandType::Clear;
+		return skipSpace(e, end) == end;
+	}
+	if (tokenIs(p, e, "set"))
+	{
+		cmd.type = CommandType::SetParam;
+		p = skipSpace(e, end);
+		e = tokenEnd(p, end);
+		if (tokenIs(p, e, "gravity")) cmd.param = ParamId::Gravity;
+		else if (tokenIs(p, e, "ttl")) cmd.param = ParamId::TTL;
+		else if (tokenIs(p, e, "scale")) cmd.param = ParamId::Scale;
+		else return false;
+		p = e;
+		if (!nextNumber(p, end, cmd.value) || skipSpace(p, end) != end) return false;
+		return commandInRange(cmd);
+	}
+	return false;
+}
+
+bool commandInRange(const Command& cmd)
+{
+	switch (cmd.type)
+	{
+	case CommandType::Spawn:
+		return cmd.count >= 0 && cmd.count <= MAX_SPAWN_COUNT
+			&& (cmd.numPoints == 0 || (cmd.numPoints >= 3 && cmd.numPoints <= MAX_POINTS));
+	case CommandType::Clear:
+		return true;
+	case CommandType::SetParam:
+		// nan or inf would poison every particle, and particles need a positive ttl and scale
+		if (cmd.param != ParamId::Gravity && cmd.param != ParamId::TTL && cmd.param != ParamId::Scale) return false;
+		if (!isfinite(cmd.value)) return false;
+		return cmd.param == ParamId::Gravity || cmd.value > 0;
+	}
+	return false;
+}
+
+CommandQueue::CommandQueue(size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity) size <<= 1;
+
+	m_cells.reset(new Cell[size]);
+	m_mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+	{
+		m_cells[i].sequence.store(i, memory_order_relaxed);
+	}
+	m_enqueuePos.store(0, memory_order_relaxed);
+	m_dequeuePos = 0;
+	m_drains = 0;
+	m_waiters = 0;
+}
+
+bool CommandQueue::push(const Command& cmd)
+{
+	size_t pos = m_enqueuePos.load(memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[pos & m_mask];
+		size_t seq = cell.sequence.load(memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0)
+		{
+			// the slot is free, try to claim it
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+			{
+				cell.cmd = cmd;
+				// publish the command to the consumer
+				cell.sequence.store(pos + 1, memory_order_release);
+				return true;
+			}
+			// another producer won, pos now holds the current position
+		}
+		else if (diff < 0)
+		{
+			// the consumer has not released this slot yet: the queue is full
+			return false;
+		}
+		else
+		{
+			pos = m_enqueuePos.load(memory_order_relaxed);
+		}
+	}
+}
+
+bool CommandQueue::pop(Command& cmd)
+{
+	Cell& cell = m_cells[m_dequeuePos & m_mask];
+	size_t seq = cell.sequence.load(memory_order_acquire);
+
+	// the producer that claimed this slot has not finished writing it
+	if (seq != m_dequeuePos + 1) return false;
+
+	cmd = cell.cmd;
+	// hand the slot back to the producers for the next lap
+	cell.sequence.store(m_dequeuePos + m_mask + 1, memory_order_release);
+	m_dequeuePos++;
+	return true;
+}
+
+void CommandQueue::waitForDrain(size_t seen, int timeoutMs)
+{
+	unique_lock<mutex> lock(m_drainMutex);
+	m_waiters++;
+	m_drainCv.wait_for(lock, chrono::milliseconds(timeoutMs), [&]() { return drains() != seen; });
+	m_waiters--;
+}
+
+void CommandQueue::notifyDrained()
+{
+	m_drains.fetch_add(1);
+
+	// Nobody is waiting in the common case, so skip the lock.
+	// A producer counts itself as a waiter before checking m_drains, so it can't miss this drain
+	if (m_waiters.load() == 0) return;
+	{
+		lock_guard<mutex> lock(m_drainMutex);
+	}
+	m_drainCv.notify_all();
+}
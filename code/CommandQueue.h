@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+using namespace std;
+
+// What a Command asks the simulation to do
+enum class CommandType : uint8_t
+{
+	Spawn,		// spawn particles at (x, y) in pixel coordinates
+	Clear,		// erase every live particle
+	SetParam	// change one of the simulation parameters
+};
+
+// Which simulation parameter a SetParam command changes
+enum class ParamId : uint8_t
+{
+	Gravity,
+	TTL,
+	Scale
+};
+
+// A single request for the simulation, small enough to copy into the ring buffer
+struct Command
+{
+	CommandType type = CommandType::Spawn;
+	ParamId param = ParamId::Gravity;
+	int x = 0;
+	int y = 0;
+	int count = 1;		// number of particles to spawn
+	int numPoints = 0;	// vertices per particle, 0 picks a random count
+	float value = 0;	// new value for SetParam
+};
+
+// Largest count and vertices per particle a spawn command may ask for,
+// anything bigger is rejected by parseCommand rather than risk exhausting memory
+const int MAX_SPAWN_COUNT = 10000;
+const int MAX_POINTS = 1000;
+
+///True if cmd's values are safe to apply: a spawn count of 0 (a random count, as
+///mouse clicks use) up to MAX_SPAWN_COUNT, 0 or 3 to MAX_POINTS points, and a
+///finite SetParam value that is positive for ttl and scale.
+///Checked for every command that comes from outside the process.
+bool commandInRange(const Command& cmd);
+
+///Parse one line of the text control protocol into cmd.
+///Returns false if the line is not a valid command, or its values are out of range.
+///  spawn X Y [COUNT] [POINTS]
+///  clear
+///  set gravity|ttl|scale VALUE
+bool parseCommand(const char* begin, const char* end, Command& cmd);
+
+///Bounded lock-free multi-producer / single-consumer queue of Commands.
+///Any thread may push(), only the simulation thread may pop().
+///Each slot carries a sequence number so producers claim slots with a single
+///compare-and-swap and the consumer never takes a lock.
+class CommandQueue
+{
+public:
+	///capacity is rounded up to the next power of two
+	explicit CommandQueue(size_t capacity = 1 << 16);
+
+	///Try to enqueue cmd.  Returns false if the queue is full.
+	bool push(const Command& cmd);
+
+	///Try to dequeue into cmd.  Returns false if the queue is empty.
+	bool pop(Command& cmd);
+
+	///Number of times the consumer has drained the queue.
+	///Read it before push(), and if the push fails pass it to waitForDrain().
+	size_t drains() const { return m_drains.load(memory_order_acquire); }
+
+	///Block a producer until the consumer drains again after seen, or timeoutMs passes
+	void waitForDrain(size_t seen, int timeoutMs);
+
+	///Called by the consumer after each drain to wake producers waiting for room
+	void notifyDrained();
+
+	size_t capacity() const { return m_mask + 1; }
+
+private:
+	struct Cell
+	{
+		atomic<size_t> sequence;
+		Command cmd;
+	};
+
+	unique_ptr<Cell[]> m_cells;
+	size_t m_mask;
+
+	// producers and the consumer each get their own cache line
+	alignas(64) atomic<size_t> m_enqueuePos;
+	alignas(64) size_t m_dequeuePos;
+
+	// Producers that find the queue full sleep here instead of spinning
+	atomic<size_t> m_drains;
+	atomic<int> m_waiters;
+	mutex m_drainMutex;
+	condition_variable m_drainCv;
+};
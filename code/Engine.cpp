@@ -1,18 +1,121 @@
 #include "Engine.h"
+#include <cstdlib>
+#include <ctime>
+
+// Length of every frame in a headless run
+const float HEADLESS_DT = 1.0f / 60;
 
 // The Engine constructor
-Engine::Engine()
+Engine::Engine(const EngineOptions& options) : m_governor(options.frameBudgetMs), m_saveSnapshotPath(options.saveSnapshotPath)
 {
-    //create the window
-    int pixelWidth = VideoMode::getDesktopMode().width / 2;
-    int pixelHeight = VideoMode::getDesktopMode().height / 2;
-    VideoMode vm(pixelWidth, pixelHeight);
-    m_Window.create(vm, "Particles", Style::Default);
+    m_replaying = !options.replayPath.empty();
+    m_seed = 0;
+    m_headlessFrames = m_replaying ? -1 : options.headlessFrames;
+
+    if (m_replaying)
+    {
+        // A replay runs headless at the window size it was recorded with
+        if (!m_replay.open(options.replayPath)) exit(1);
+        m_headless.reset(new HeadlessTarget(m_replay.size()));
+        m_target = m_headless.get();
+    }
+    else if (m_headlessFrames >= 0)
+    {
+        // A headless run uses the size the window would have had
+        Vector2u size(VideoMode::getDesktopMode().width / 2, VideoMode::getDesktopMode().height / 2);
+        m_headless.reset(new HeadlessTarget(size));
+        m_target = m_headless.get();
+    }
+    else
+    {
+        //create the window
+        int pixelWidth = VideoMode::getDesktopMode().width / 2;
+        int pixelHeight = VideoMode::getDesktopMode().height / 2;
+        VideoMode vm(pixelWidth, pixelHeight);
+        // A recording stores one window size and replays at it, so the window can't be resized while recording
+        m_Window.create(vm, "Particles", options.recordPath.empty() ? Style::Default : Style::Titlebar | Style::Close);
+        m_target = &m_Window;
+    }
+
+    // Warm-start from a snapshot if one was given
+    if (!options.loadSnapshotPath.empty())
+    {
+        Clock clock;
+        if (loadSnapshot(options.loadSnapshotPath, *m_target, m_particles, m_params))
+        {
+            cout << "Restored " << m_particles.size() << " particles from " << options.loadSnapshotPath
+                << " in " << clock.getElapsedTime().asMilliseconds() << " ms" << endl;
+        }
+    }
+
+    // A replay only reproduces the session if it starts from the same state the recording did
+    if (m_replaying && (m_particles.size() != m_replay.startParticleCount() || hashState(m_particles, m_params) != m_replay.startHash()))
+    {
+        cerr << "The recording started from " << m_replay.startParticleCount() << " particles with state hash "
+            << hex << m_replay.startHash() << ", but the replay starts from " << m_particles.size()
+            << " with state hash " << hashState(m_particles, m_params) << dec
+            << ". Pass the --load-snapshot the recording was made with." << endl;
+        exit(1);
+    }
+
+    // Start the external command readers, if any were requested
+        // A replay only takes its commands from the log
+    if (!m_replaying && (options.listenStdin || !options.socketPath.empty()))
+    {
+        m_listener.reset(new CommandListener(m_commands));
+        if (options.listenStdin) m_listener->listenStdin();
+        if (!options.socketPath.empty()) m_listener->listenSocket(options.socketPath);
+    }
+
+    // Set up the offscreen texture and writer thread for exporting frames
+    if (!options.exportDirectory.empty())
+    {
+        Vector2u size = m_target->getSize();
+        m_exportTexture.reset(new RenderTexture());
+        if (m_exportTexture->create(size.x, size.y))
+        {
+            m_exportTexture->setView(FrameExporter::flippedView(size));
+            m_exporter.reset(new FrameExporter(options.exportDirectory, options.exportFormat, size));
+            if (m_exporter->isOpen()) cout << "Exporting " << size.x << "x" << size.y << " frames to " << options.exportDirectory << endl;
+        }
+        else
+        {
+            cerr << "Could not create a " << size.x << "x" << size.y << " texture for export" << endl;
+        }
+
+        // Without somewhere to write, don't render every frame a second time for nothing
+        if (!m_exporter || !m_exporter->isOpen())
+        {
+            m_exporter.reset();
+            m_exportTexture.reset();
+        }
+    }
+
+    // Pick a seed for rand() and start recording
+    if (!m_replaying && !options.recordPath.empty())
+    {
+        m_seed = (unsigned)time(nullptr);
+        if (m_recorder.open(options.recordPath, m_seed, m_target->getSize(), m_particles.size(), hashState(m_particles, m_params)))
+        {
+            cout << "Recording to " << options.recordPath << " with seed " << m_seed << endl;
+        }
+    }
 }
 
 // Run will call all the private functions
 void Engine::run()
 {
+    if (m_replaying)
+    {
+        replay();
+        return;
+    }
+    if (m_headlessFrames >= 0)
+    {
+        runHeadless();
+        return;
+    }
+
     // Construct a local Clock object to track time per frame
     Clock clock;
 
@@ -24,14 +127,89 @@ void Engine::run()
     p.unitTests();
     cout << "Unit tests complete.  Starting engine..." << endl;
 
+    // Seed rand() after the unit tests so a replay draws exactly the same numbers
+    if (m_recorder.isOpen()) srand(m_seed);
+
     // Loop while m_Window is open
     while (m_Window.isOpen())
     {
         // Restart the clock (this will return the time elapsed since the last frame)
         // Call input, update, draw
         input();
-        update(clock.restart().asSeconds());
+        float frameSeconds = clock.restart().asSeconds();
+        update(frameSeconds);
+        float updateSeconds = clock.getElapsedTime().asSeconds();
         draw();
+        // Measure before display(), which may block waiting for vsync and would count as draw cost
+        float drawSeconds = clock.getElapsedTime().asSeconds() - updateSeconds;
+        m_Window.display();
+        if (m_exporter) exportFrame();
+
+        // Let the governor measure this frame against the budget, and report when it changes its mind
+        ThrottleLevel level = m_governor.metrics().level;
+        size_t particleCap = m_governor.metrics().particleCap;
+        m_governor.setParticleTTL(m_params.ttl);
+        if (m_governor.frame(frameSeconds, updateSeconds, drawSeconds, m_particles.size()))
+        {
+            cout << m_governor.metrics() << endl;
+        }
+
+        // The governor's decisions depend on timing, so a replay takes them from the log instead
+        if (m_recorder.isOpen())
+        {
+            if (m_governor.metrics().level != level || m_governor.metrics().particleCap != particleCap)
+            {
+                m_recorder.governor(m_governor.metrics().level, m_governor.metrics().particleCap);
+            }
+            m_recorder.flush();
+        }
+    }
+
+    shutdown();
+}
+
+// Run a fixed number of frames of HEADLESS_DT without a window, timing the whole run
+    // Commands from --stdin or --listen are still applied, and the run can be recorded
+void Engine::runHeadless()
+{
+    if (m_recorder.isOpen()) srand(m_seed);
+
+    Clock clock;
+    for (int i = 0; i < m_headlessFrames; i++)
+    {
+        update(HEADLESS_DT);
+        if (m_exporter) exportFrame();
+        if (m_recorder.isOpen()) m_recorder.flush();
+    }
+
+    float wall = clock.getElapsedTime().asSeconds();
+    cout << "Simulated " << m_headlessFrames << " frames in " << wall << " s, "
+        << m_particles.size() << " particles left" << endl;
+    if (!m_recorder.isOpen()) cout << "State hash " << hex << hashState(m_particles, m_params) << dec << endl;
+
+    shutdown();
+}
+
+void Engine::shutdown()
+{
+    // Stop the command readers before the queue they feed goes away
+    if (m_listener) m_listener->stop();
+
+    if (m_exporter)
+    {
+        m_exporter->finish();
+        cout << "Exported " << m_exporter->framesWritten() << " frames" << endl;
+    }
+
+    if (m_recorder.isOpen())
+    {
+        m_recorder.close();
+        cout << "Recorded " << m_recorder.bytesWritten() << " bytes, state hash " << hex << hashState(m_particles, m_params) << dec << endl;
+    }
+
+    if (!m_saveSnapshotPath.empty() && saveSnapshot(m_saveSnapshotPath, m_particles, m_params))
+    {
+        cout << "Saved " << m_particles.size() << " particles to " << m_saveSnapshotPath << endl;
     }
 }
 
@@ -53,22 +231,89 @@ void Engine::input()
             // Handle the left mouse button pressed event 
             if (event.mouseButton.button == Mouse::Left)
             {
-                // construct a number of (5) particles
-                for (int i = 0; i < rand() % 10 + 8; i++)
-                {
-                    // numPoints is a random number in the range [25:50] (you can experiment with this too)
-                    // Pass the position of the mouse click into the constructor
-                    m_particles.push_back(Particle(m_Window, rand() % 40 + 45, Vector2i(event.mouseButton.x, event.mouseButton.y)));
-                }
+                // Queue a spawn of a random number of particles at the mouse click,
+                // they are constructed with everything else in applyCommands()
+                    // The count is picked there too, so every rand() call happens during update() and can be replayed
+                Command cmd;
+                cmd.type = CommandType::Spawn;
+                cmd.x = event.mouseButton.x;
+                cmd.y = event.mouseButton.y;
+                cmd.count = 0;
+                // If external producers have filled the queue the click is dropped rather than stalling the frame
+                m_commands.push(cmd);
             }
         }
     }
 }
 
+// Drain the command queue once per step
+    // Only the commands already queued when we start are applied, so a fast producer can't keep us here forever
+    // Once the frame has spawned its allowance the rest stay queued for the next step
+void Engine::applyCommands()
+{
+    Command cmd;
+    for (size_t i = 0; i < m_commands.capacity(); i++)
+    {
+        // A replay applies exactly the commands each frame was recorded with
+        if (!m_replaying && !m_governor.spawnAllowanceLeft()) break;
+        if (!m_commands.pop(cmd)) break;
+
+        if (m_recorder.isOpen()) m_recorder.command(cmd);
+
+        switch (cmd.type)
+        {
+        case CommandType::Spawn:
+            spawn(Vector2i(cmd.x, cmd.y), cmd.count, cmd.numPoints);
+            break;
+        case CommandType::Clear:
+            m_particles.clear();
+            break;
+        case CommandType::SetParam:
+            if (cmd.param == ParamId::Gravity) m_params.gravity = cmd.value;
+            else if (cmd.param == ParamId::TTL) m_params.ttl = cmd.value;
+            else if (cmd.param == ParamId::Scale) m_params.scale = cmd.value;
+            break;
+        }
+    }
+
+    // Wake any command readers that were waiting for room in the queue
+    m_commands.notifyDrained();
+}
+
+// Construct count particles at position
+    // count of 0 picks a random number of particles, numPoints of 0 picks a random number of points for each particle
+void Engine::spawn(Vector2i position, int count, int numPoints)
+{
+    // construct a random number of particles in the range [8:17]
+    if (count <= 0) count = rand() % 10 + 8;
+
+    // The governor may cap the count, and thin out or shorten the life of new particles when over budget
+    count = m_governor.allowSpawns(count);
+    float ttl = m_governor.ttl(m_params.ttl);
+
+    for (int i = 0; i < count; i++)
+    {
+        // numPoints is a random number in the range [45:84] (you can experiment with this too)
+        // Pass the position of the mouse click into the constructor
+        int points = m_governor.points(numPoints > 0 ? numPoints : rand() % 40 + 45);
+        m_particles.push_back(Particle(*m_target, points, position, ttl));
+    }
+}
+
 // The general idea here is to loop through m_particles and call update on each Particle in the vector whose ttl (time to live) has not expired
     // If a particle's ttl has expired, it must be erased from the vector
 void Engine::update(float dtAsSeconds)
 {
+    m_governor.startFrame();
+    if (m_recorder.isOpen()) m_recorder.frame(dtAsSeconds);
+
+    // Apply spawns, clears and parameter changes queued since the last step
+    applyCommands();
+
+    // When the governor is retiring particles, drop the oldest ones first (they are at the front)
+    size_t retire = m_governor.retireCount(m_particles.size());
+    m_particles.erase(m_particles.begin(), m_particles.begin() + retire);
+
     // This is best done with an iterator - based for - loop
         // Don't automatically increment the iterator for each iteration
     for (vector<Particle>::iterator iterator = m_particles.begin(); iterator != m_particles.end();)
@@ -77,7 +322,7 @@ void Engine::update(float dtAsSeconds)
         if (iterator->getTTL() > 0.0)
         {   
             // Call update on that Particle
-            iterator->update(dtAsSeconds);
+            iterator->update(dtAsSeconds, m_params.gravity, m_params.scale);
             // increment the iterator
             iterator++;
         }
@@ -93,19 +338,95 @@ void Engine::update(float dtAsSeconds)
     }
 }
 
+// Run every frame of the recording back to back
+    // Commands are pushed into the queue so update() applies them exactly where it did when recording
+void Engine::replay()
+{
+    cout << "Replaying with seed " << m_replay.seed() << " at " << m_replay.size().x << "x" << m_replay.size().y << endl;
+    srand(m_replay.seed());
+
+    Clock clock;
+    size_t frames = 0;
+    double simulated = 0;
+    bool haveFrame = false;
+    float dt = 0;
+
+    ReplayEvent event;
+    while (m_replay.next(event))
+    {
+        switch (event.type)
+        {
+        case EventType::Frame:
+            // a new frame starts, so the previous one has all of its commands
+            if (haveFrame) replayStep(dt);
+            dt = event.dt;
+            haveFrame = true;
+            frames++;
+            simulated += dt;
+            break;
+        case EventType::Spawn:
+        case EventType::Clear:
+        case EventType::SetParam:
+            m_commands.push(event.cmd);
+            break;
+        case EventType::Governor:
+            // governor decisions are recorded after the frame that made them
+            if (haveFrame) replayStep(dt);
+            haveFrame = false;
+            m_governor.force(event.level, event.particleCap);
+            break;
+        }
+    }
+    if (haveFrame) replayStep(dt);
+    if (m_exporter) m_exporter->finish();
+
+    float wall = clock.getElapsedTime().asSeconds();
+    if (m_replay.truncated()) cout << "Recording is truncated or damaged, replayed up to the damage" << endl;
+    cout << "Replayed " << frames << " frames (" << simulated << " s) in " << wall << " s, "
+        << (wall > 0 ? simulated / wall : 0) << "x real time" << endl;
+    if (m_exporter) cout << "Exported " << m_exporter->framesWritten() << " frames" << endl;
+    cout << "State hash " << hex << hashState(m_particles, m_params) << dec << endl;
+
+    if (!m_saveSnapshotPath.empty() && saveSnapshot(m_saveSnapshotPath, m_particles, m_params))
+    {
+        cout << "Saved " << m_particles.size() << " particles to " << m_saveSnapshotPath << endl;
+    }
+}
+
+void Engine::replayStep(float dt)
+{
+    update(dt);
+    if (m_exporter) exportFrame();
+}
+
 void Engine::draw()
 {
     // clear the window
     m_Window.clear();
 
+    drawParticles(m_Window);
+
+    // the window is displayed by run(), after the governor has timed the drawing
+}
+
+void Engine::drawParticles(RenderTarget& target)
+{
     // Loop through each Particle in m_Particles 
-    for (Particle particle : m_particles)
+        // By reference, a copy would duplicate every particle's vertex matrix each frame
+    for (const Particle& particle : m_particles)
     {
-        // Pass each element into m_Window.draw()
+        // Pass each element into target.draw()
         // Note:  This will use polymorphism to call your Particle::draw() function
-        m_Window.draw(particle);
+        target.draw(particle);
     }
+}
 
-    // display the window
-    m_Window.display();
+// Render the frame again into the export texture and hand its pixels to the writer thread
+    // This only blocks when the writer has fallen a whole queue of frames behind
+void Engine::exportFrame()
+{
+    m_exportTexture->clear();
+    drawParticles(*m_exportTexture);
+    m_exportTexture->display();
+    m_exporter->capture(*m_exportTexture);
 }
\ No newline at end of file
@@ -1,27 +1,120 @@
 #pragma once
 #pragma once
 #include <SFML/Graphics.hpp>
+#include <memory>
+#include <string>
 #include "Particle.h"
+#include "CommandQueue.h"
+#include "CommandListener.h"
+#include "FrameGovernor.h"
+#include "Snapshot.h"
+#include "Recording.h"
+#include "FrameExporter.h"
 using namespace sf;
 using namespace std;
 
+// Start-up options, filled in from the command line by main()
+struct EngineOptions
+{
+	// read control commands from standard input
+	bool listenStdin = false;
+	// read control commands from a UNIX-domain socket at this path (empty for none)
+	string socketPath;
+	// target update + draw time per frame in milliseconds, 0 disables the governor
+	float frameBudgetMs = 16.6f;
+	// restore the simulation from this snapshot at start-up (empty for none)
+	string loadSnapshotPath;
+	// save the simulation to this snapshot when the engine stops (empty for none)
+	string saveSnapshotPath;
+	// record every frame, command and RNG seed to this log (empty for none)
+	string recordPath;
+	// replay this log headless as fast as possible instead of opening a window (empty for none)
+	string replayPath;
+	// run this many fixed-length frames without a window and stop, -1 to open a window
+	int headlessFrames = -1;
+	// render every frame offscreen and write it to this directory (empty for none)
+	string exportDirectory;
+	ExportFormat exportFormat = ExportFormat::PPM;
+};
+
+// A RenderTarget with a size but no window or OpenGL context, used for headless runs
+	// Particles only need it to map between pixel and Cartesian coordinates, it is never drawn to
+class HeadlessTarget : public RenderTarget
+{
+public:
+	explicit HeadlessTarget(Vector2u size) : m_size(size) {}
+	Vector2u getSize() const override { return m_size; }
+
+private:
+	Vector2u m_size;
+};
+
 class Engine
 {
 private:
 	// A regular RenderWindow
 	RenderWindow m_Window;
 
+	// Where particles are created, m_Window or a HeadlessTarget when replaying
+	RenderTarget* m_target;
+	unique_ptr<HeadlessTarget> m_headless;
+
 	//vector for Particles
 	vector<Particle> m_particles;
 
+	// Current simulation parameters, changed by SetParam commands
+	Parameters m_params;
+
+	// Spawn / clear / parameter commands from the window and any external producers
+	CommandQueue m_commands;
+	unique_ptr<CommandListener> m_listener;
+
+	// Throttles spawns and quality to keep each frame within budget
+	FrameGovernor m_governor;
+
+	// Where to save a snapshot when the engine stops
+	string m_saveSnapshotPath;
+
+	// Session recording, and the log being replayed in headless mode
+	Recorder m_recorder;
+	ReplayLog m_replay;
+	bool m_replaying;
+	unsigned m_seed;
+
+	// Frames to simulate without a window, -1 for a normal windowed run
+	int m_headlessFrames;
+
+	// Offscreen copy of every frame for export
+	unique_ptr<RenderTexture> m_exportTexture;
+	unique_ptr<FrameExporter> m_exporter;
+
 	// Private functions for internal use only
 	void input();
 	void update(float dtAsSeconds);
 	void draw();
 
+	// Draw every particle to target, shared by the window and the export texture
+	void drawParticles(RenderTarget& target);
+	// Render the current frame offscreen and queue it for the exporter
+	void exportFrame();
+
+	// Drain the command queue and apply each command to the simulation
+	void applyCommands();
+	void spawn(Vector2i position, int count, int numPoints);
+
+	// Feed m_replay through update() without a window
+	void replay();
+	void replayStep(float dt);
+
+	// Simulate m_headlessFrames frames without a window, as fast as possible
+	void runHeadless();
+
+	// Stop the readers and writers and save the final state, shared by windowed and headless runs
+	void shutdown();
+
 public:
 	// The Engine constructor
-	Engine();
+	Engine(const EngineOptions& options = EngineOptions());
 
 	// Run will call all the private functions
 	void run();
@@ -0,0 +1,162 @@
+#include "FrameExporter.h"
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+#include <SFML/OpenGL.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+FrameExporter::FrameExporter(const string& directory, ExportFormat format, Vector2u size, size_t queueDepth)
+	: m_directory(directory), m_format(format), m_size(size)
+{
+	m_open = false;
+	m_raw = nullptr;
+	m_captured = 0;
+	m_written = 0;
+	m_stop = false;
+
+	error_code ec;
+	filesystem::create_directories(m_directory, ec);
+	if (ec)
+	{
+		cerr << "Could not create export directory " << m_directory << ": " << ec.message() << endl;
+		return;
+	}
+
+	if (m_format == ExportFormat::Raw)
+	{
+		string path = (filesystem::path(m_directory) / "frames.rgba").string();
+		m_raw = fopen(path.c_str(), "wb");
+		if (!m_raw)
+		{
+			cerr << "Could not open " << path << " for writing" << endl;
+			return;
+		}
+		// whole frames go straight from our buffers to the OS, stdio buffering would only add a copy
+		setvbuf(m_raw, nullptr, _IONBF, 0);
+	}
+
+	// Allocate every buffer up front, after this frames only move between the two queues
+	// PPM has no alpha channel, so those frames are read back as RGB and written out as they are
+	size_t bytesPerPixel = m_format == ExportFormat::PPM ? 3 : 4;
+	m_pool.resize(max(queueDepth, (size_t)2));
+	for (Frame& frame : m_pool)
+	{
+		frame.pixels.resize((size_t)m_size.x * m_size.y * bytesPerPixel);
+		m_free.push_back(&frame);
+	}
+
+	m_open = true;
+	m_writer = thread(&FrameExporter::writerLoop, this);
+}
+
+FrameExporter::~FrameExporter()
+{
+	finish();
+}
+
+View FrameExporter::flippedView(Vector2u size)
+{
+	View view;
+	view.setCenter(size.x / 2.f, size.y / 2.f);
+	view.setSize((float)size.x, -(float)size.y);
+	return view;
+}
+
+void FrameExporter::capture(RenderTexture& texture)
+{
+	if (!m_open) return;
+
+	// Wait for a free buffer, this is the only place the simulation can block
+	Frame* frame;
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_freeCv.wait(lock, [this]() { return !m_free.empty(); });
+		frame = m_free.front();
+		m_free.pop_front();
+	}
+
+	// Read the pixels directly into the recycled buffer (texture.copyToImage() would allocate and copy again)
+	texture.setActive(true);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	GLenum layout = m_format == ExportFormat::PPM ? GL_RGB : GL_RGBA;
+	glReadPixels(0, 0, m_size.x, m_size.y, layout, GL_UNSIGNED_BYTE, frame->pixels.data());
+	frame->index = m_captured++;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_ready.push_back(frame);
+	}
+	m_readyCv.notify_one();
+}
+
+void FrameExporter::finish()
+{
+	if (!m_writer.joinable()) return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_readyCv.notify_one();
+	m_writer.join();
+
+	if (m_raw)
+	{
+		fclose(m_raw);
+		m_raw = nullptr;
+	}
+	m_open = false;
+}
+
+void FrameExporter::writerLoop()
+{
+	for (;;)
+	{
+		Frame* frame;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_readyCv.wait(lock, [this]() { return m_stop || !m_ready.empty(); });
+			if (m_ready.empty()) break;
+			frame = m_ready.front();
+			m_ready.pop_front();
+		}
+
+		if (write(*frame)) m_written++;
+
+		// hand the buffer back for the next capture
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_free.push_back(frame);
+		}
+		m_freeCv.notify_one();
+	}
+}
+
+bool FrameExporter::write(const Frame& frame)
+{
+	size_t width = m_size.x;
+	size_t height = m_size.y;
+
+	if (m_format == ExportFormat::Raw)
+	{
+		return fwrite(frame.pixels.data(), 1, frame.pixels.size(), m_raw) == frame.pixels.size();
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "frame_%06zu.ppm", frame.index);
+	string path = (filesystem::path(m_directory) / name).string();
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		cerr << "Could not open " << path << " for writing" << endl;
+		return false;
+	}
+
+	// the buffer already holds packed RGB rows top first, exactly the PPM pixel data
+	fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+	bool ok = fwrite(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+	fclose(file);
+	return ok;
+}
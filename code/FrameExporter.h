@@ -0,0 +1,78 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace sf;
+using namespace std;
+
+// How exported frames are stored
+enum class ExportFormat
+{
+	Raw,	// every frame appended to one frames.rgba file, 8-bit RGBA, top row first
+	PPM		// one binary frame_NNNNNN.ppm per frame, read back as RGB
+};
+
+///Streams rendered frames to disk on a background thread.
+///A fixed pool of pixel buffers is recycled between the simulation and the
+///writer through a bounded queue.  capture() reads the pixels from the GPU
+///straight into a free buffer, which is the only copy a frame ever gets, and
+///only blocks when every buffer is still waiting to be written.
+class FrameExporter
+{
+public:
+	///Write frames of the given size into directory, which is created if needed
+	FrameExporter(const string& directory, ExportFormat format, Vector2u size, size_t queueDepth = 8);
+	~FrameExporter();
+
+	FrameExporter(const FrameExporter&) = delete;
+	FrameExporter& operator=(const FrameExporter&) = delete;
+
+	///False if the output could not be created
+	bool isOpen() const { return m_open; }
+
+	///Queue the current contents of texture, which must be the exporter's size.
+	///The texture should have been drawn with flippedView() so rows come back top first.
+	void capture(RenderTexture& texture);
+
+	///Write out every queued frame and stop the writer thread
+	void finish();
+
+	size_t framesWritten() const { return m_written; }
+
+	///A view for texture that draws upside down, so reading it back from
+	///OpenGL (bottom row first) yields the rows top first with no extra pass
+	static View flippedView(Vector2u size);
+
+private:
+	struct Frame
+	{
+		vector<Uint8> pixels;
+		size_t index;
+	};
+
+	string m_directory;
+	ExportFormat m_format;
+	Vector2u m_size;
+	bool m_open;
+	FILE* m_raw;
+	size_t m_captured;
+	atomic<size_t> m_written;
+
+	vector<Frame> m_pool;
+	deque<Frame*> m_free;
+	deque<Frame*> m_ready;
+	mutex m_mutex;
+	condition_variable m_freeCv;
+	condition_variable m_readyCv;
+	bool m_stop;
+	thread m_writer;
+
+	void writerLoop();
+	bool write(const Frame& frame);
+};
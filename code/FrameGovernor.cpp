@@ -0,0 +1,172 @@
+#include "FrameGovernor.h"
+#include <algorithm>
+
+// Weight of the newest frame in the smoothed cost
+const float SMOOTHING = 0.25f;
+// Consecutive frames over budget before throttling one level harder
+const int ESCALATE_FRAMES = 5;
+// How long to wait after capping spawns before escalating again, the cap stops growth at once
+const float SPAWN_CAP_COOLDOWN = 1.0f;
+// Fraction of the particle TTL to wait after thinning out or shortening new particles,
+// by then about half of the live particles were spawned under the new level
+const float TTL_COOLDOWN = 0.5f;
+// Consecutive frames under RESTORE_RATIO * budget before restoring one level
+const int RESTORE_FRAMES = 90;
+const float RESTORE_RATIO = 0.6f;
+// Fraction of the budget the particle cap aims for when retiring particles
+const float RETIRE_TARGET = 0.8f;
+
+// Particles spawned per frame before the rest of the queued spawns wait for the next one, at any level
+const size_t SPAWN_ALLOWANCE = 4096;
+// Per-level settings
+const size_t SPAWN_CAP = 256;
+const size_t SPAWN_CAP_TIGHT = 64;
+const float POINTS_SCALE = 0.5f;
+const float TTL_SCALE = 0.5f;
+const int MIN_POINTS = 8;
+
+ostream& operator<<(ostream& os, const GovernorMetrics& m)
+{
+	os << "governor level " << (int)m.level
+		<< "  frame " << m.averageMs << "/" << m.budgetMs << " ms"
+		<< "  spawn cap " << m.spawnCap
+		<< "  points x" << m.pointsScale
+		<< "  ttl x" << m.ttlScale
+		<< "  particle cap " << m.particleCap
+		<< "  retired " << m.retired
+		<< "  dropped spawns " << m.droppedSpawns;
+	return os;
+}
+
+FrameGovernor::FrameGovernor(float budgetMs)
+{
+	m_metrics.budgetMs = budgetMs;
+	m_overFrames = 0;
+	m_underFrames = 0;
+	m_spawnedThisFrame = 0;
+	m_msPerParticle = 0;
+	m_particleTTL = 0;
+	m_cooldown = 0;
+}
+
+bool FrameGovernor::frame(float frameSeconds, float updateSeconds, float drawSeconds, size_t particleCount)
+{
+	if (!enabled()) return false;
+
+	m_cooldown = max(0.f, m_cooldown - frameSeconds);
+
+	float ms = (updateSeconds + drawSeconds) * 1000;
+	m_metrics.lastMs = ms;
+	m_metrics.averageMs += SMOOTHING * (ms - m_metrics.averageMs);
+	if (particleCount > 0)
+	{
+		m_msPerParticle += SMOOTHING * (ms / particleCount - m_msPerParticle);
+	}
+
+	// Track how long we have been on either side of the hysteresis band
+	if (m_metrics.averageMs > m_metrics.budgetMs)
+	{
+		m_overFrames++;
+		m_underFrames = 0;
+	}
+	else if (m_metrics.averageMs < m_metrics.budgetMs * RESTORE_RATIO)
+	{
+		m_underFrames++;
+		m_overFrames = 0;
+	}
+	else
+	{
+		m_overFrames = 0;
+		m_underFrames = 0;
+	}
+
+	ThrottleLevel level = m_metrics.level;
+	if (m_overFrames >= ESCALATE_FRAMES && m_cooldown == 0 && level != ThrottleLevel::RetireOldest)
+	{
+		ThrottleLevel next = (ThrottleLevel)((int)level + 1);
+		apply(next);
+		m_overFrames = 0;
+
+		// Give the new throttle time to work before judging whether it was enough
+		if (next == ThrottleLevel::CapSpawns) m_cooldown = SPAWN_CAP_COOLDOWN;
+		else if (next == ThrottleLevel::FewerPoints || next == ThrottleLevel::ShorterTTL) m_cooldown = m_particleTTL * TTL_COOLDOWN;
+	}
+	else if (m_underFrames >= RESTORE_FRAMES && level != ThrottleLevel::None)
+	{
+		apply((ThrottleLevel)((int)level - 1));
+		m_underFrames = 0;
+		m_cooldown = 0;
+	}
+
+	// While retiring, keep the particle cap in step with the measured cost per particle
+	if (m_metrics.level == ThrottleLevel::RetireOldest && m_msPerParticle > 0)
+	{
+		float cap = m_metrics.budgetMs * RETIRE_TARGET / m_msPerParticle;
+		m_metrics.particleCap = max((size_t)1, (size_t)cap);
+	}
+
+	return m_metrics.level != level;
+}
+
+void FrameGovernor::apply(ThrottleLevel level)
+{
+	m_metrics.level = level;
+	m_metrics.spawnCap = 0;
+	m_metrics.pointsScale = 1;
+	m_metrics.ttlScale = 1;
+	m_metrics.particleCap = 0;
+
+	if (level >= ThrottleLevel::CapSpawns) m_metrics.spawnCap = SPAWN_CAP;
+	if (level >= ThrottleLevel::FewerPoints) m_metrics.pointsScale = POINTS_SCALE;
+	if (level >= ThrottleLevel::ShorterTTL)
+	{
+		m_metrics.ttlScale = TTL_SCALE;
+		m_metrics.spawnCap = SPAWN_CAP_TIGHT;
+	}
+}
+
+void FrameGovernor::force(ThrottleLevel level, size_t particleCap)
+{
+	apply(level);
+	m_metrics.particleCap = particleCap;
+}
+
+int FrameGovernor::allowSpawns(int requested)
+{
+	if (m_metrics.spawnCap == 0 || requested <= 0)
+	{
+		m_spawnedThisFrame += max(requested, 0);
+		return requested;
+	}
+
+	size_t left = m_metrics.spawnCap > m_spawnedThisFrame ? m_metrics.spawnCap - m_spawnedThisFrame : 0;
+	size_t allowed = min((size_t)requested, left);
+	m_spawnedThisFrame += allowed;
+	m_metrics.droppedSpawns += requested - allowed;
+	return (int)allowed;
+}
+
+bool FrameGovernor::spawnAllowanceLeft() const
+{
+	return m_spawnedThisFrame < SPAWN_ALLOWANCE;
+}
+
+int FrameGovernor::points(int numPoints) const
+{
+	if (m_metrics.pointsScale >= 1 || numPoints <= MIN_POINTS) return numPoints;
+	return max(MIN_POINTS, (int)(numPoints * m_metrics.pointsScale));
+}
+
+float FrameGovernor::ttl(float ttl) const
+{
+	return ttl * m_metrics.ttlScale;
+}
+
+size_t FrameGovernor::retireCount(size_t particleCount)
+{
+	if (m_metrics.particleCap == 0 || particleCount <= m_metrics.particleCap) return 0;
+
+	size_t count = particleCount - m_metrics.particleCap;
+	m_metrics.retired += count;
+	return count;
+}
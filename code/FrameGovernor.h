@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+using namespace std;
+
+// How hard the governor is currently throttling, each level includes the ones below it
+enum class ThrottleLevel
+{
+	None,			// full quality
+	CapSpawns,		// limit the number of particles spawned per frame
+	FewerPoints,	// new particles get fewer vertices
+	ShorterTTL,		// new particles live for less time
+	RetireOldest	// erase the oldest particles to fit the frame budget
+};
+
+// The governor's current decisions, exposed so they can be logged or displayed
+struct GovernorMetrics
+{
+	ThrottleLevel level = ThrottleLevel::None;
+	float budgetMs = 0;			// target update + draw time per frame
+	float lastMs = 0;			// update + draw time of the last frame
+	float averageMs = 0;		// smoothed update + draw time
+	size_t spawnCap = 0;		// max particles spawned per frame, 0 for unlimited
+	float pointsScale = 1;		// multiplier on vertices per new particle
+	float ttlScale = 1;			// multiplier on the TTL of new particles
+	size_t particleCap = 0;		// max live particles, 0 for unlimited
+	size_t retired = 0;			// particles retired early since start
+	size_t droppedSpawns = 0;	// spawns refused by the spawn cap since start
+};
+
+ostream& operator<<(ostream& os, const GovernorMetrics& m);
+
+///Adaptive frame-budget governor.
+///Measures the update and draw cost of every frame against a target budget
+///and steps through the ThrottleLevels when the smoothed cost goes over it.
+///Quality is only restored one level at a time after a sustained period of
+///headroom, so the two thresholds form a hysteresis band and the level does
+///not oscillate around the budget.  After each escalation the governor waits
+///for that throttle to take effect before it escalates again: the vertex and
+///TTL throttles only apply to new particles, so they need a fraction of the
+///particle TTL before the existing population has turned over.
+class FrameGovernor
+{
+public:
+	///budgetMs of 0 disables the governor
+	explicit FrameGovernor(float budgetMs = 16.6f);
+
+	///Call at the start of every simulation step, before any spawns
+	void startFrame() { m_spawnedThisFrame = 0; }
+
+	///Record the cost of one frame that took frameSeconds of wall time.
+	///Returns true if the throttle level changed.
+	bool frame(float frameSeconds, float updateSeconds, float drawSeconds, size_t particleCount);
+
+	///Time to live of particles spawned at full quality, used to size the cooldowns.
+	///Call before frame() whenever it may have changed.
+	void setParticleTTL(float ttl) { m_particleTTL = ttl; }
+
+	///How many of the requested particles may be spawned this frame.
+	///Call once per spawn request, the remainder is counted as dropped.
+	int allowSpawns(int requested);
+
+	///False once this frame has spawned its full allowance, even at ThrottleLevel::None.
+	///Callers should leave further spawn requests queued for the next frame.
+	bool spawnAllowanceLeft() const;
+
+	///Scale the number of vertices and time to live for a new particle
+	int points(int numPoints) const;
+	float ttl(float ttl) const;
+
+	///How many of the oldest particles to retire so the rest fit in the budget
+	size_t retireCount(size_t particleCount);
+
+	///Set the level and particle cap directly instead of measuring, used when replaying a recording
+	void force(ThrottleLevel level, size_t particleCap);
+
+	bool enabled() const { return m_metrics.budgetMs > 0; }
+	const GovernorMetrics& metrics() const { return m_metrics; }
+
+private:
+	GovernorMetrics m_metrics;
+	int m_overFrames;		// consecutive frames above the budget
+	int m_underFrames;		// consecutive frames comfortably below it
+	size_t m_spawnedThisFrame;
+	float m_msPerParticle;	// smoothed cost of one live particle
+	float m_particleTTL;
+	float m_cooldown;		// seconds left before the next escalation is allowed
+
+	void apply(ThrottleLevel level);
+};
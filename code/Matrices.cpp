@@ -1,65 +1,249 @@
 #include "Matrices.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <thread>
 
 namespace Matrices
 {
-	Matrix::Matrix(int _rows, int _cols)
+	template <typename T>
+	BasicMatrix<T>::BasicMatrix(int _rows, int _cols)
 	{
 		rows = _rows;
 		cols = _cols;
 
-		a.resize(rows, vector<double>(cols, 0));
+		a.resize(rows, vector<T>(cols, 0));
 	}
 
 	// usage: c = a + b;
-	Matrix operator+(const Matrix& a, const Matrix& b)
+	template <typename T>
+	BasicMatrix<T> operator+(const BasicMatrix<T>& a, const BasicMatrix<T>& b)
 	{
 		int rows = a.getRows();
 		int cols = a.getCols();
 
-		//if (!(rows == b.getRows() && cols == b.getCols())) throw runtime_error("Error: dimensions must agree");
+		if (!(rows == b.getRows() && cols == b.getCols())) throw runtime_error("Error: dimensions must agree");
 
-		Matrix out(rows, cols);
+		BasicMatrix<T> out(rows, cols);
 
+		// Work on whole rows so the inner loop has no bounds checks and can be vectorized
 		for (int i = 0; i < rows; i++)
 		{
+			const T* rowA = a.row(i);
+			const T* rowB = b.row(i);
+			T* rowOut = out.row(i);
 			for (int j = 0; j < cols; j++)
 			{
-				out(i, j) = a(i, j) + b(i, j);
+				rowOut[j] = rowA[j] + rowB[j];
 			}
 		}
 
 		return out;
 	}
 
+	namespace
+	{
+		// Below this many multiply-adds the packing overhead of the blocked path isn't worth it
+		const long long SMALL_GEMM = 96 * 96 * 96;
+		// Below this many multiply-adds one thread is faster than starting more
+		const long long THREADED_GEMM = 192LL * 192 * 192;
+
+		// Register block computed by the microkernel, and the cache blocks around it:
+		// an MC x KC block of a stays in L2, a KC x NC panel of b in L3
+		const int MR = 4;
+		const int NR = 8;
+		const int MC = 128;
+		const int KC = 256;
+		const int NC = 2048;
+
+		// Smallest rows of a, columns of b and inner dimension the blocked path is used for
+		const int MIN_BLOCKED_ROWS = 4 * MR;
+		const int MIN_BLOCKED_COLS = 4 * NR;
+		const int MIN_BLOCKED_INNER = KC / 4;
+
+		// Copy rows [i0, i0 + mc) x columns [p0, p0 + kc) of a into MR-row micro-panels,
+		// each stored column by column, so the microkernel reads it sequentially
+		// Rows past the edge are padded with zeros
+		template <typename T>
+		void packA(const BasicMatrix<T>& a, int i0, int mc, int p0, int kc, T* packed)
+		{
+			for (int ir = 0; ir < mc; ir += MR)
+			{
+				for (int i = 0; i < MR; i++)
+				{
+					const T* row = ir + i < mc ? a.row(i0 + ir + i) + p0 : nullptr;
+					for (int p = 0; p < kc; p++)
+					{
+						packed[p * MR + i] = row ? row[p] : 0;
+					}
+				}
+				packed += MR * kc;
+			}
+		}
+
+		// Copy rows [p0, p0 + kc) x columns [j0, j0 + nc) of b into NR-column micro-panels,
+		// each stored row by row, padded with zeros past the edge
+		template <typename T>
+		void packB(const BasicMatrix<T>& b, int p0, int kc, int j0, int nc, T* packed)
+		{
+			for (int jr = 0; jr < nc; jr += NR)
+			{
+				int nr = min(NR, nc - jr);
+				for (int p = 0; p < kc; p++)
+				{
+					const T* row = b.row(p0 + p) + j0 + jr;
+					for (int j = 0; j < nr; j++) packed[p * NR + j] = row[j];
+					for (int j = nr; j < NR; j++) packed[p * NR + j] = 0;
+				}
+				packed += NR * kc;
+			}
+		}
+
+		// Fully unroll a loop with a constant trip count, so an array indexed by its counter can live in registers
+		// MSVC unrolls these on its own and has no equivalent pragma
+		#if defined(__GNUC__)
+		#define UNROLL_FULLY _Pragma("GCC unroll 16")
+		#else
+		#define UNROLL_FULLY
+		#endif
+
+		// C[0:mr, 0:nr] += A * B for one MR x kc micro-panel of a and one kc x NR micro-panel of b
+		// The MR x NR accumulator is small enough to stay in registers, once the loops over it are unrolled
+		template <typename T>
+		void microKernel(int kc, const T* A, const T* B, T* const* C, int col, int mr, int nr)
+		{
+			T acc[MR][NR] = {};
+			for (int p = 0; p < kc; p++)
+			{
+				const T* Bp = B + p * NR;
+				UNROLL_FULLY
+				for (int i = 0; i < MR; i++)
+				{
+					T aip = A[p * MR + i];
+					UNROLL_FULLY
+					for (int j = 0; j < NR; j++)
+					{
+						acc[i][j] += aip * Bp[j];
+					}
+				}
+			}
+			for (int i = 0; i < mr; i++)
+			{
+				T* c = C[i] + col;
+				for (int j = 0; j < nr; j++) c[j] += acc[i][j];
+			}
+		}
+
+		// Multiply rows [rowBegin, rowEnd) of a, columns [pc, pc + kc), by one packed kc x nc panel of b,
+		// adding into rows [rowBegin, rowEnd), columns [jc, jc + nc) of out
+		// Each thread calls this for its own rows with the same panel, so they never write to the same place
+		template <typename T>
+		void gemmPanel(const BasicMatrix<T>& a, const T* packedB, BasicMatrix<T>& out,
+			int pc, int kc, int jc, int nc, int rowBegin, int rowEnd)
+		{
+			// Each call packs its own blocks of a into a local buffer: it is small next to the panel's work,
+			// and being local the compiler knows it can't alias out, which keeps the inner loops tight
+			vector<T> blockA((size_t)MC * KC);
+			T* packedA = blockA.data();
+			T* rowsOut[MR];
+			for (int ic = rowBegin; ic < rowEnd; ic += MC)
+			{
+				int mc = min(MC, rowEnd - ic);
+				packA(a, ic, mc, pc, kc, packedA);
+
+				for (int jr = 0; jr < nc; jr += NR)
+				{
+					for (int ir = 0; ir < mc; ir += MR)
+					{
+						int mr = min(MR, mc - ir);
+						for (int i = 0; i < mr; i++) rowsOut[i] = out.row(ic + ir + i);
+						microKernel(kc, packedA + ir * kc, packedB + jr * kc, rowsOut, jc + jr, mr, min(NR, nc - jr));
+					}
+				}
+			}
+		}
+	}
+
 	// usage: c = a * b;
-	Matrix operator*(const Matrix& a, const Matrix& b)
+	template <typename T>
+	BasicMatrix<T> operator*(const BasicMatrix<T>& a, const BasicMatrix<T>& b)
 	{
 		int colsA = a.getCols();
-		//int rowsB = b.getRows();
+		int rowsB = b.getRows();
 
-		//if (!(colsA == rowsB)) throw runtime_error("Error: dimensions must agree");
+		// both paths index b by the columns of a, so check before picking one
+		if (!(colsA == rowsB)) throw runtime_error("Error: dimensions must agree");
 
 		int rowsA = a.getRows();
 		int colsB = b.getCols();
 
-		Matrix out(rowsA, colsB);
-		for (int i = 0; i < rowsA; i++)
+		BasicMatrix<T> out(rowsA, colsB);
+		long long work = (long long)rowsA * colsB * colsA;
+
+		// Packing pads every block out to MR rows and NR columns and only pays off when each
+		// dimension fills several of them, skinny products like the 2 x n particle transforms don't
+		bool blocked = work >= SMALL_GEMM && rowsA >= MIN_BLOCKED_ROWS && colsB >= MIN_BLOCKED_COLS && colsA >= MIN_BLOCKED_INNER;
+		if (!blocked)
 		{
-			for (int j = 0; j < colsB; j++)
+			// i-k-j order streams whole rows of b and out, so the inner loop vectorizes
+			for (int i = 0; i < rowsA; i++)
 			{
-				double total = 0.0;
+				const T* rowA = a.row(i);
+				T* rowOut = out.row(i);
 				for (int k = 0; k < colsA; k++)
 				{
-					total += a(i, k) * b(k, j);
+					T aik = rowA[k];
+					const T* rowB = b.row(k);
+					for (int j = 0; j < colsB; j++)
+					{
+						rowOut[j] += aik * rowB[j];
+					}
 				}
-				out(i, j) = total;
 			}
+			return out;
 		}
+
+		// Large matrices: packed, cache-blocked multiply, with the rows split across threads
+		int threads = 1;
+		if (work >= THREADED_GEMM)
+		{
+			threads = max(1, (int)thread::hardware_concurrency());
+			threads = min(threads, (rowsA + MC - 1) / MC);
+		}
+
+		// Give each thread a whole number of microkernel rows
+		int chunk = ((rowsA + threads - 1) / threads + MR - 1) / MR * MR;
+
+		// Each panel of b is packed once and shared read-only by every thread
+		int ncMax = (min(NC, colsB) + NR - 1) / NR * NR;
+		vector<T> packedB((size_t)KC * ncMax);
+
+		for (int jc = 0; jc < colsB; jc += NC)
+		{
+			int nc = min(NC, colsB - jc);
+			for (int pc = 0; pc < colsA; pc += KC)
+			{
+				int kc = min(KC, colsA - pc);
+				packB(b, pc, kc, jc, nc, packedB.data());
+
+				// This thread takes the first rows, the others start on the rest of the panel
+				vector<thread> workers;
+				for (int begin = chunk; begin < rowsA; begin += chunk)
+				{
+					workers.emplace_back(gemmPanel<T>, cref(a), (const T*)packedB.data(), ref(out),
+						pc, kc, jc, nc, begin, min(rowsA, begin + chunk));
+				}
+				gemmPanel(a, packedB.data(), out, pc, kc, jc, nc, 0, min(rowsA, chunk));
+				for (thread& worker : workers) worker.join();
+			}
+		}
+
 		return out;
 	}
 
 	// usage: a == b
-	bool operator==(const Matrix& a, const Matrix& b)
+	template <typename T>
+	bool operator==(const BasicMatrix<T>& a, const BasicMatrix<T>& b)
 	{
 		int rowA = a.getRows();
 		int rowB = b.getRows();
@@ -81,14 +265,16 @@ namespace Matrices
 	}
 
 	// usage: a != b
-	bool operator!=(const Matrix& a, const Matrix& b)
+	template <typename T>
+	bool operator!=(const BasicMatrix<T>& a, const BasicMatrix<T>& b)
 	{
 		return !(a == b);
 	}
 
 	// Output matrix.
 	// Separate columns by ' ' and rows by '\n'
-	ostream& operator<<(ostream& os, const Matrix& a)
+	template <typename T>
+	ostream& operator<<(ostream& os, const BasicMatrix<T>& a)
 	{
 		int rows = a.getRows();
 		int cols = a.getCols();
@@ -106,34 +292,56 @@ namespace Matrices
 		return os;
 	}
 
-	RotationMatrix::RotationMatrix(double theta) : Matrix(2, 2)
+	template <typename T>
+	BasicRotationMatrix<T>::BasicRotationMatrix(double theta) : BasicMatrix<T>(2, 2)
 	{
 		// cos(theta) - sin(theta)
 		// sin(theta)   cos(theta)
-		a[0][0] = cos(theta);
-		a[0][1] = -sin(theta);
-		a[1][0] = sin(theta);
-		a[1][1] = cos(theta);
+		// the angle is computed in double and rounded once, whatever T is
+		this->a[0][0] = (T)cos(theta);
+		this->a[0][1] = (T)-sin(theta);
+		this->a[1][0] = (T)sin(theta);
+		this->a[1][1] = (T)cos(theta);
 	}
 
-	ScalingMatrix::ScalingMatrix(double scale) : Matrix(2, 2)
+	template <typename T>
+	BasicScalingMatrix<T>::BasicScalingMatrix(double scale) : BasicMatrix<T>(2, 2)
 	{
 		// scale   0
 		// 0       scale
-		a[0][0] = scale;
-		a[0][1] = 0;
-		a[1][0] = 0;
-		a[1][1] = scale;
+		this->a[0][0] = (T)scale;
+		this->a[0][1] = 0;
+		this->a[1][0] = 0;
+		this->a[1][1] = (T)scale;
 	}
 
-	TranslationMatrix::TranslationMatrix(double xShift, double yShift, int nCols) : Matrix(2, nCols)
+	template <typename T>
+	BasicTranslationMatrix<T>::BasicTranslationMatrix(double xShift, double yShift, int nCols) : BasicMatrix<T>(2, nCols)
 	{
 		// xShift  xShift  xShift  ...
 		// yShift  yShift  yShift  ...
 		for (int i = 0; i < nCols; i++)
 		{
-			a[0][i] = xShift;
-			a[1][i] = yShift;
+			this->a[0][i] = (T)xShift;
+			this->a[1][i] = (T)yShift;
 		}
 	}
-}
\ No newline at end of file
+
+	// Explicit instantiations: float for particle vertices, double for everything else
+	#define INSTANTIATE_MATRICES(T) \
+		template class BasicMatrix<T>; \
+		template class BasicRotationMatrix<T>; \
+		template class BasicScalingMatrix<T>; \
+		template class BasicTranslationMatrix<T>; \
+		template BasicMatrix<T> operator+(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+		template BasicMatrix<T> operator*(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+		template bool operator==(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+		template bool operator!=(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+		template ostream& operator<<(ostream&, const BasicMatrix<T>&);
+
+	INSTANTIATE_MATRICES(float)
+	INSTANTIATE_MATRICES(double)
+
+	#undef INSTANTIATE_MATRICES
+	#undef UNROLL_FULLY
+}
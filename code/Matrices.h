@@ -9,66 +9,87 @@ using namespace std;
 
 namespace Matrices
 {
-    class Matrix
+    ///Every class and operator is a template on the scalar type T.
+    ///Definitions live in Matrices.cpp, which instantiates them for float and double.
+    ///Matrix, RotationMatrix, ScalingMatrix and TranslationMatrix are the double versions.
+    template <typename T>
+    class BasicMatrix
     {
         public:
+            typedef T Scalar;
+
             ///Construct a matrix of the specified size.
             ///Initialize each element to 0.
-            Matrix(int _rows, int _cols);
+            BasicMatrix(int _rows, int _cols);
 
             ///************************************
             ///inline accessors / mutators, these are done:
 
             ///Read element at row i, column j
             ///usage:  double x = a(i,j);
-            const double& operator()(int i, int j) const
+            const T& operator()(int i, int j) const
             {
                 return a.at(i).at(j);
             }
 
             ///Assign element at row i, column j
             ///usage:  a(i,j) = x;
-            double& operator()(int i, int j)
+            T& operator()(int i, int j)
             {
                 return a.at(i).at(j);
             }
 
             int getRows() const{return rows;}
             int getCols() const{return cols;}
+
+            ///Contiguous storage of row i, for bulk copies
+            ///usage:  memcpy(dest, a.row(0), a.getCols() * sizeof(T));
+            const T* row(int i) const{return a[i].data();}
+            T* row(int i){return a[i].data();}
             ///************************************
         protected:
             ///changed to protected so sublasses can modify
-            vector<vector<double>> a;
+            vector<vector<T>> a;
         private:
             int rows;
             int cols;
     };
 
+    typedef BasicMatrix<double> Matrix;
+
     ///Add each corresponding element.
     ///usage:  c = a + b;
-    Matrix operator+(const Matrix& a, const Matrix& b);
+    template <typename T>
+    BasicMatrix<T> operator+(const BasicMatrix<T>& a, const BasicMatrix<T>& b);
 
     ///Matrix multiply.  See description.
+    ///Small products use a simple row-streaming loop, large ones a packed,
+    ///cache-blocked kernel split across threads by rows of a.
     ///usage:  c = a * b;
-    Matrix operator*(const Matrix& a, const Matrix& b);
+    template <typename T>
+    BasicMatrix<T> operator*(const BasicMatrix<T>& a, const BasicMatrix<T>& b);
 
     ///Matrix comparison.  See description.
     ///usage:  a == b
-    bool operator==(const Matrix& a, const Matrix& b);
+    template <typename T>
+    bool operator==(const BasicMatrix<T>& a, const BasicMatrix<T>& b);
 
     ///Matrix comparison.  See description.
     ///usage:  a != b
-    bool operator!=(const Matrix& a, const Matrix& b);
+    template <typename T>
+    bool operator!=(const BasicMatrix<T>& a, const BasicMatrix<T>& b);
 
     ///Output matrix.
     ///Separate columns by ' ' and rows by '\n'
-    ostream& operator<<(ostream& os, const Matrix& a);
+    template <typename T>
+    ostream& operator<<(ostream& os, const BasicMatrix<T>& a);
 
     /*******************************************************************************/
 
     ///2D rotation matrix
     ///usage:  A = R * A rotates A theta radians counter-clockwise
-    class RotationMatrix : public Matrix
+    template <typename T>
+    class BasicRotationMatrix : public BasicMatrix<T>
     {
         public:
             ///Call the parent constructor to create a 2x2 matrix
@@ -78,12 +99,15 @@ namespace Matrices
             sin(theta)   cos(theta)
             */
             ///theta represents the angle of rotation in radians, counter-clockwise
-            RotationMatrix(double theta);
+            BasicRotationMatrix(double theta);
     };
 
+    typedef BasicRotationMatrix<double> RotationMatrix;
+
     ///2D scaling matrix
     ///usage:  A = S * A expands or contracts A by the specified scaling factor
-    class ScalingMatrix : public Matrix
+    template <typename T>
+    class BasicScalingMatrix : public BasicMatrix<T>
     {
         public:
             ///Call the parent constructor to create a 2x2 matrix
@@ -93,12 +117,15 @@ namespace Matrices
             0       scale
             */
             ///scale represents the size multiplier
-            ScalingMatrix(double scale);
+            BasicScalingMatrix(double scale);
     };
 
+    typedef BasicScalingMatrix<double> ScalingMatrix;
+
     ///2D Translation matrix
     ///usage:  A = T + A will shift all coordinates of A by (xShift, yShift)
-    class TranslationMatrix : public Matrix
+    template <typename T>
+    class BasicTranslationMatrix : public BasicMatrix<T>
     {
         public:
             ///Call the parent constructor to create a 2xn matrix
@@ -110,8 +137,10 @@ namespace Matrices
             ///paramaters are xShift, yShift, and nCols
             ///nCols represents the number of columns in the matrix
             ///where each column contains one (x,y) coordinate pair
-            TranslationMatrix(double xShift, double yShift, int nCols);
+            BasicTranslationMatrix(double xShift, double yShift, int nCols);
     };
+
+    typedef BasicTranslationMatrix<double> TranslationMatrix;
 }
 
 #endif // MATRIX_H_INCLUDED
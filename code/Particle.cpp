@@ -1,4 +1,5 @@
 #include "Particle.h"
+#include <algorithm>
 
 /*
 * - This constructor will be responsible for generating a randomized shape with numPoints vertices,
@@ -11,10 +12,10 @@
 * be constructed in an initialization list before the code for the constructor begins:
 *     - Particle(...) : m_A(2, numPoints)
 */
-Particle::Particle(RenderTarget& target, int numPoints, Vector2i mouseClickPosition) : m_A(2, numPoints)
+Particle::Particle(RenderTarget& target, int numPoints, Vector2i mouseClickPosition, float ttl) : m_A(2, numPoints)
 {
-    // Initialize m_ttl with the global constant TTL, which gives it a time to live of 5 seconds
-    m_ttl = TTL;
+    // Initialize m_ttl with ttl, which defaults to the global constant TTL and gives it a time to live of 5 seconds
+    m_ttl = ttl;
 
     // Initialize m_numPoints with numPoints
     m_numPoints = numPoints;
@@ -88,6 +89,41 @@ Particle::Particle(RenderTarget& target, int numPoints, Vector2i mouseClickPosit
     }
 }
 
+// Rebuild a Particle saved with getState(), the vertices are copied row by row straight into m_A
+Particle::Particle(RenderTarget& target, const ParticleState& state, const ParticleScalar* xs, const ParticleScalar* ys) : m_A(2, state.numPoints)
+{
+    m_ttl = state.ttl;
+    m_numPoints = state.numPoints;
+    m_centerCoordinate = Vector2f(state.centerX, state.centerY);
+    m_radiansPerSec = state.radiansPerSec;
+    m_vx = state.vx;
+    m_vy = state.vy;
+    m_color1 = Color(state.color1);
+    m_color2 = Color(state.color2);
+
+    // The Cartesian plane only depends on the size of the target, so it is set up the same way as a new particle
+    m_cartesianPlane.setCenter(0, 0);
+    m_cartesianPlane.setSize(target.getSize().x, (-1.0) * target.getSize().y);
+
+    copy(xs, xs + m_numPoints, m_A.row(0));
+    copy(ys, ys + m_numPoints, m_A.row(1));
+}
+
+ParticleState Particle::getState() const
+{
+    ParticleState state;
+    state.ttl = m_ttl;
+    state.numPoints = m_numPoints;
+    state.centerX = m_centerCoordinate.x;
+    state.centerY = m_centerCoordinate.y;
+    state.radiansPerSec = m_radiansPerSec;
+    state.vx = m_vx;
+    state.vy = m_vy;
+    state.color1 = m_color1.toInteger();
+    state.color2 = m_color2.toInteger();
+    return state;
+}
+
 // This function overrides the virtual function from sf::Drawable to allow our draw function to polymorph
 // To draw, we will convert our Cartesian matrix coordinates from m_A to pixel coordinates in a VertexArray of primitive type TriangleFan 
 void Particle::draw(RenderTarget & target, RenderStates states) const
@@ -124,7 +160,7 @@ void Particle::draw(RenderTarget & target, RenderStates states) const
     target.draw(lines);
 }
 
-void Particle::update(float dt)
+void Particle::update(float dt, float gravity, float scale)
 {
     // Subtract dt from m_ttl
     m_ttl -= dt;
@@ -132,10 +168,10 @@ void Particle::update(float dt)
     // Call rotate with an angle of dt * m_radiansPerSec
     rotate(dt * m_radiansPerSec);
 
-    // Call scale using the global constant SCALE from Particle.h
+    // Call scale using scale, which defaults to the global constant SCALE from Particle.h
         // SCALE will effectively act as the percentage to scale per frame
         // 0.999 experimentally seemed to shrink the particle at a nice speed that wasn't too fast or too slow (you can change this)
-    scale(SCALE);
+    this->scale(scale);
 
     // Next we will calculate how far to shift / translate our particle, using distance (dx,dy)
         
@@ -147,8 +183,8 @@ void Particle::update(float dt)
     // The vertical velocity should change by some gravitational constant G, also experimentally determined and defined in Particle.h
         // This will allow the particle to travel up then fall down as if having an initial upward velocity and then getting pulled down by gravity
 
-    // Subtract G * dt from m_vy
-    m_vy -= G * dt;
+    // Subtract gravity * dt from m_vy (gravity defaults to G)
+    m_vy -= gravity * dt;
     // Assign m_vy * dt to dy
     dy = m_vy * dt;
 
@@ -159,7 +195,7 @@ void Particle::update(float dt)
 void Particle::translate(double xShift, double yShift)
 {
     // Construct a TranslationMatrix T with the specified shift values xShift and yShift
-    TranslationMatrix T(xShift, yShift, m_numPoints);
+    BasicTranslationMatrix<ParticleScalar> T(xShift, yShift, m_numPoints);
 
     // Add it to m_A as m_A = T + m_A
     m_A = T + m_A;
@@ -184,7 +220,7 @@ void Particle::rotate(double theta)
     translate(-m_centerCoordinate.x, -m_centerCoordinate.y);
 
     // Construct a RotationMatrix R with the specified angle of rotation theta
-    RotationMatrix R(theta);
+    BasicRotationMatrix<ParticleScalar> R(theta);
 
     // Multiply it by m_A as m_A = R * m_A
         /* Note: make sure to left-multiply r, as matrix multiplication is not commutative
@@ -209,7 +245,7 @@ void Particle::scale(double c)
     translate(-m_centerCoordinate.x, -m_centerCoordinate.y);
 
     // Construct a ScalingMatrix S with the specified scaling multiplier c
-    ScalingMatrix S(c);
+    BasicScalingMatrix<ParticleScalar> S(c);
 
     // Multiply it by m_A as m_A = S * m_A
     m_A = S * m_A;
@@ -296,7 +332,7 @@ void Particle::unitTests()
     }
 
     cout << "Applying one rotation of 90 degrees about the origin..." << endl;
-    Matrix initialCoords = m_A;
+    VertexMatrix initialCoords = m_A;
     rotate(M_PI / 2.0);
     bool rotationPassed = true;
     for (int j = 0; j < initialCoords.getCols(); j++)
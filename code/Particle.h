@@ -1,6 +1,7 @@
 #pragma once
 #include "Matrices.h"
 #include <SFML/Graphics.hpp>
+#include <cstdint>
 
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433f
@@ -10,16 +11,56 @@ const float G = 1000;      //Gravity
 const float TTL = 5.0;  //Time To Live
 const float SCALE = 0.999;
 
+// Simulation parameters that can be changed while the engine is running,
+// they start out as the constants above
+struct Parameters
+{
+    float gravity = G;
+    float ttl = TTL;
+    float scale = SCALE;
+};
+
+// Plain copy of a Particle's state, used by snapshots
+    // The vertices in m_A are stored separately since their number varies
+struct ParticleState
+{
+    float ttl;
+    int32_t numPoints;
+    float centerX;
+    float centerY;
+    float radiansPerSec;
+    float vx;
+    float vy;
+    uint32_t color1;
+    uint32_t color2;
+};
+
+// Precision of the particle vertices in m_A
+    // float matches the Vector2f SFML draws with and halves the memory traffic of double,
+    // build with -DPARTICLES_DOUBLE_VERTICES to go back to double
+#ifdef PARTICLES_DOUBLE_VERTICES
+typedef double ParticleScalar;
+#else
+typedef float ParticleScalar;
+#endif
+
 using namespace Matrices;
+typedef BasicMatrix<ParticleScalar> VertexMatrix;
 using namespace sf;
 class Particle : public Drawable
 {
 public:
-	Particle(RenderTarget& target, int numPoints, Vector2i mouseClickPosition);
+	Particle(RenderTarget& target, int numPoints, Vector2i mouseClickPosition, float ttl = TTL);
 	virtual void draw(RenderTarget& target, RenderStates states) const override;
-    void update(float dt);
+    void update(float dt, float gravity = G, float scale = SCALE);
     float getTTL() { return m_ttl; }
 
+    // Snapshot support: copy the state out, or rebuild a Particle from a state
+    // and its vertex rows xs and ys (numPoints values each)
+    Particle(RenderTarget& target, const ParticleState& state, const ParticleScalar* xs, const ParticleScalar* ys);
+    ParticleState getState() const;
+    const VertexMatrix& getVertices() const { return m_A; }
+
     //Functions for unit testing
     bool almostEqual(double a, double b, double eps = 0.0001);
     void unitTests();
@@ -34,17 +75,17 @@ private:
     View m_cartesianPlane;
     Color m_color1;
     Color m_color2;
-    Matrix m_A;
+    VertexMatrix m_A;
 
     ///rotate Particle by theta radians counter-clockwise
-    ///construct a RotationMatrix R, left mulitply it to m_A
+    ///construct a BasicRotationMatrix R, left mulitply it to m_A
     void rotate(double theta);
 
     ///Scale the size of the Particle by factor c
-    ///construct a ScalingMatrix S, left multiply it to m_A
+    ///construct a BasicScalingMatrix S, left multiply it to m_A
     void scale(double c);
 
     ///shift the Particle by (xShift, yShift) coordinates
-    ///construct a TranslationMatrix T, add it to m_A
+    ///construct a BasicTranslationMatrix T, add it to m_A
     void translate(double xShift, double yShift);
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "Recording.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// "PREC" read as a little-endian integer
+	const uint32_t RECORDING_MAGIC = 0x43455250;
+	const uint32_t RECORDING_VERSION = 2;
+}
+
+Recorder::Recorder()
+{
+	m_file = nullptr;
+	m_bytes = 0;
+	m_stop = false;
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::open(const string& path, uint32_t seed, Vector2u size, uint64_t particleCount, uint64_t stateHash)
+{
+	m_file = fopen(path.c_str(), "wb");
+	if (!m_file)
+	{
+		cerr << "Could not open recording " << path << " for writing" << endl;
+		return false;
+	}
+
+	put(RECORDING_MAGIC);
+	put(RECORDING_VERSION);
+	put(seed);
+	put((uint32_t)size.x);
+	put((uint32_t)size.y);
+	put(particleCount);
+	put(stateHash);
+	flush();
+
+	m_stop = false;
+	m_writer = thread(&Recorder::writerLoop, this);
+	return true;
+}
+
+void Recorder::frame(float dt)
+{
+	put(EventType::Frame);
+	put(dt);
+}
+
+void Recorder::command(const Command& cmd)
+{
+	switch (cmd.type)
+	{
+	case CommandType::Spawn:
+		put(EventType::Spawn);
+		put((int32_t)cmd.x);
+		put((int32_t)cmd.y);
+		put((int32_t)cmd.count);
+		put((int32_t)cmd.numPoints);
+		break;
+	case CommandType::Clear:
+		put(EventType::Clear);
+		break;
+	case CommandType::SetParam:
+		put(EventType::SetParam);
+		put(cmd.param);
+		put(cmd.value);
+		break;
+	}
+}
+
+void Recorder::governor(ThrottleLevel level, size_t particleCap)
+{
+	put(EventType::Governor);
+	put((uint8_t)level);
+	put((uint32_t)particleCap);
+}
+
+void Recorder::flush()
+{
+	if (m_current.empty()) return;
+
+	lock_guard<mutex> lock(m_mutex);
+	if (m_pending.empty())
+	{
+		// the writer has caught up, trade buffers so both keep their capacity
+		m_pending.swap(m_current);
+	}
+	else
+	{
+		// the writer is still busy with the last block, queue behind it
+		m_pending.insert(m_pending.end(), m_current.begin(), m_current.end());
+		m_current.clear();
+	}
+	m_wake.notify_one();
+}
+
+void Recorder::close()
+{
+	if (!m_file) return;
+
+	flush();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	if (m_writer.joinable()) m_writer.join();
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void Recorder::writerLoop()
+{
+	vector<char> block;
+	for (;;)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+			if (m_pending.empty()) break;
+			block.swap(m_pending);
+		}
+
+		fwrite(block.data(), 1, block.size(), m_file);
+		m_bytes += block.size();
+		block.clear();
+	}
+	fflush(m_file);
+}
+
+bool ReplayLog::open(const string& path)
+{
+	ifstream in(path, ios::binary | ios::ate);
+	if (!in)
+	{
+		cerr << "Could not open recording " << path << endl;
+		return false;
+	}
+	m_data.resize((size_t)in.tellg());
+	in.seekg(0);
+	in.read(m_data.data(), m_data.size());
+	m_pos = 0;
+	m_truncated = false;
+
+	uint32_t magic, version, width, height;
+	if (!get(magic) || !get(version) || magic != RECORDING_MAGIC || version != RECORDING_VERSION
+		|| !get(m_seed) || !get(width) || !get(height) || !get(m_startParticleCount) || !get(m_startHash))
+	{
+		cerr << path << " is not a version " << RECORDING_VERSION << " recording" << endl;
+		return false;
+	}
+	m_size = Vector2u(width, height);
+	return true;
+}
+
+bool ReplayLog::next(ReplayEvent& event)
+{
+	if (m_pos == m_data.size()) return false;
+
+	event = ReplayEvent();
+	bool ok = get(event.type);
+	int32_t x = 0, y = 0, count = 0, numPoints = 0;
+	uint8_t level = 0;
+	uint32_t particleCap = 0;
+
+	if (ok)
+	{
+		switch (event.type)
+		{
+		case EventType::Frame:
+			ok = get(event.dt) && isfinite(event.dt) && event.dt >= 0;
+			break;
+		case EventType::Spawn:
+			ok = get(x) && get(y) && get(count) && get(numPoints);
+			event.cmd.type = CommandType::Spawn;
+			event.cmd.x = x;
+			event.cmd.y = y;
+			event.cmd.count = count;
+			event.cmd.numPoints = numPoints;
+			ok = ok && commandInRange(event.cmd);
+			break;
+		case EventType::Clear:
+			event.cmd.type = CommandType::Clear;
+			break;
+		case EventType::SetParam:
+			event.cmd.type = CommandType::SetParam;
+			ok = get(event.cmd.param) && get(event.cmd.value) && commandInRange(event.cmd);
+			break;
+		case EventType::Governor:
+			ok = get(level) && get(particleCap) && level <= (uint8_t)ThrottleLevel::RetireOldest;
+			event.level = (ThrottleLevel)level;
+			event.particleCap = particleCap;
+			break;
+		default:
+			ok = false;
+			break;
+		}
+	}
+
+	if (!ok)
+	{
+		// a recording cut short by a crash still replays up to the damage,
+		// and so does one with an event that could never have been recorded
+		m_truncated = true;
+		m_pos = m_data.size();
+	}
+	return ok;
+}
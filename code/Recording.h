@@ -0,0 +1,142 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CommandQueue.h"
+#include "FrameGovernor.h"
+using namespace sf;
+using namespace std;
+
+///Append-only log of everything that makes a session non-deterministic:
+///the RNG seed, the window size, the length of every frame, every command
+///the simulation applied and every decision of the frame governor.
+///Feeding it back through a headless Engine reproduces the session exactly.
+///The header also identifies the state the session started from (a loaded
+///snapshot, or nothing), so a replay can refuse to start from anything else.
+///
+///File layout (native byte order):
+///  "PREC", version, seed, width, height        (uint32 each)
+///  particleCount, stateHash                    (uint64 each, hashState() at the start)
+///  a stream of events, each a one byte tag followed by its payload:
+///    Frame     float dt
+///    Spawn     int32 x, y, count, numPoints
+///    Clear     -
+///    SetParam  uint8 param, float value
+///    Governor  uint8 level, uint32 particleCap
+
+enum class EventType : uint8_t
+{
+	Frame = 1,
+	Spawn,
+	Clear,
+	SetParam,
+	Governor
+};
+
+// One decoded event from a log
+struct ReplayEvent
+{
+	EventType type = EventType::Frame;
+	float dt = 0;
+	Command cmd;
+	ThrottleLevel level = ThrottleLevel::None;
+	size_t particleCap = 0;
+};
+
+///Writes a recording.  Events are appended to an in-memory block on the
+///frame thread, and once per frame the block is handed to a background
+///thread that does the actual file I/O, so recording never waits on disk.
+class Recorder
+{
+public:
+	Recorder();
+	~Recorder();
+
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	///Create the log at path and start the writer thread.
+	///particleCount and stateHash describe the state the session starts from.
+	bool open(const string& path, uint32_t seed, Vector2u size, uint64_t particleCount, uint64_t stateHash);
+	bool isOpen() const { return m_file != nullptr; }
+
+	void frame(float dt);
+	void command(const Command& cmd);
+	void governor(ThrottleLevel level, size_t particleCap);
+
+	///Hand everything recorded so far to the writer thread
+	void flush();
+
+	///Write out what is left, stop the writer and close the file
+	void close();
+
+	uint64_t bytesWritten() const { return m_bytes; }
+
+private:
+	FILE* m_file;
+	atomic<uint64_t> m_bytes;
+
+	// the frame thread appends to m_current, the writer drains m_pending
+	vector<char> m_current;
+	vector<char> m_pending;
+	mutex m_mutex;
+	condition_variable m_wake;
+	bool m_stop;
+	thread m_writer;
+
+	void writerLoop();
+
+	template <typename T>
+	void put(const T& value)
+	{
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		m_current.insert(m_current.end(), bytes, bytes + sizeof(T));
+	}
+};
+
+///Reads a recording back one event at a time
+class ReplayLog
+{
+public:
+	///Load the log at path.  Returns false if it is missing or not a recording.
+	bool open(const string& path);
+
+	uint32_t seed() const { return m_seed; }
+	Vector2u size() const { return m_size; }
+
+	///The particle count and hashState() the recorded session started from
+	uint64_t startParticleCount() const { return m_startParticleCount; }
+	uint64_t startHash() const { return m_startHash; }
+
+	///Decode the next event.  Returns false at the end of the log.
+	bool next(ReplayEvent& event);
+
+	///True if the log ended in the middle of an event, or an event had
+	///out of range values (see commandInRange); replay stops there
+	bool truncated() const { return m_truncated; }
+
+private:
+	vector<char> m_data;
+	size_t m_pos = 0;
+	uint32_t m_seed = 0;
+	Vector2u m_size;
+	uint64_t m_startParticleCount = 0;
+	uint64_t m_startHash = 0;
+	bool m_truncated = false;
+
+	template <typename T>
+	bool get(T& value)
+	{
+		if (m_pos + sizeof(T) > m_data.size()) return false;
+		memcpy(&value, m_data.data() + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return true;
+	}
+};
@@ -0,0 +1,252 @@
+#include "Snapshot.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// "PSNP" read as a little-endian integer, a file from a machine with a different byte order won't match
+	const uint32_t SNAPSHOT_MAGIC = 0x504E5350;
+	const uint32_t SNAPSHOT_VERSION = 2;
+
+	struct SnapshotHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t particleCount;
+		uint64_t vertexCount;	// total number of vertices (columns of m_A) over all particles
+		float gravity;
+		float ttl;
+		float scale;
+		uint32_t scalarSize;	// sizeof(ParticleScalar) of the build that wrote it
+	};
+
+	struct SnapshotRecord
+	{
+		ParticleState state;
+		uint32_t reserved;
+		uint64_t vertexOffset;	// index of this particle's first vertex in the vertex section
+	};
+
+	static_assert(is_trivially_copyable<SnapshotHeader>::value && sizeof(SnapshotHeader) == 40, "snapshot header layout changed");
+	static_assert(is_trivially_copyable<SnapshotRecord>::value && sizeof(SnapshotRecord) == 48, "snapshot record layout changed");
+
+	const uint64_t FNV_OFFSET = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+
+	uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// A read-only mapping of a whole file, unmapped when it goes out of scope
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const string& path)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (m_file == INVALID_HANDLE_VALUE) return;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) return;
+			m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!m_mapping) return;
+			m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+			if (m_data) m_size = (size_t)size.QuadPart;
+#else
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0)
+			{
+				void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED)
+				{
+					// we read the file front to back exactly once
+					madvise(data, st.st_size, MADV_SEQUENTIAL);
+					m_data = static_cast<const char*>(data);
+					m_size = st.st_size;
+				}
+			}
+			// the mapping stays valid after the descriptor is closed
+			close(fd);
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (m_data) UnmapViewOfFile(m_data);
+			if (m_mapping) CloseHandle(m_mapping);
+			if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+			if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+#endif
+	};
+}
+
+bool saveSnapshot(const string& path, const vector<Particle>& particles, const Parameters& params)
+{
+	SnapshotHeader header = {};
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.particleCount = particles.size();
+	header.gravity = params.gravity;
+	header.ttl = params.ttl;
+	header.scale = params.scale;
+	header.scalarSize = sizeof(ParticleScalar);
+	for (const Particle& particle : particles)
+	{
+		header.vertexCount += particle.getVertices().getCols();
+	}
+
+	// Lay out the whole file in memory so it goes to disk in one write
+	size_t recordsStart = sizeof(SnapshotHeader);
+	size_t verticesStart = recordsStart + particles.size() * sizeof(SnapshotRecord);
+	vector<char> buffer(verticesStart + header.vertexCount * 2 * sizeof(ParticleScalar));
+
+	memcpy(buffer.data(), &header, sizeof(header));
+	SnapshotRecord* records = reinterpret_cast<SnapshotRecord*>(buffer.data() + recordsStart);
+	ParticleScalar* vertices = reinterpret_cast<ParticleScalar*>(buffer.data() + verticesStart);
+
+	uint64_t offset = 0;
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		const VertexMatrix& A = particles[i].getVertices();
+		size_t n = A.getCols();
+
+		SnapshotRecord record = {};
+		record.state = particles[i].getState();
+		record.vertexOffset = offset;
+		records[i] = record;
+
+		memcpy(vertices + 2 * offset, A.row(0), n * sizeof(ParticleScalar));
+		memcpy(vertices + 2 * offset + n, A.row(1), n * sizeof(ParticleScalar));
+		offset += n;
+	}
+
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out)
+	{
+		cerr << "Could not open snapshot " << path << " for writing" << endl;
+		return false;
+	}
+	out.write(buffer.data(), buffer.size());
+	out.close();
+	if (!out)
+	{
+		cerr << "Could not write snapshot " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+bool loadSnapshot(const string& path, RenderTarget& target, vector<Particle>& particles, Parameters& params)
+{
+	MappedFile file(path);
+	if (!file.data() || file.size() < sizeof(SnapshotHeader))
+	{
+		cerr << "Could not map snapshot " << path << endl;
+		return false;
+	}
+
+	const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(file.data());
+	if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION)
+	{
+		cerr << path << " is not a version " << SNAPSHOT_VERSION << " snapshot" << endl;
+		return false;
+	}
+	if (header->scalarSize != sizeof(ParticleScalar))
+	{
+		cerr << "Snapshot " << path << " has " << header->scalarSize * 8 << "-bit vertices, this build uses "
+			<< sizeof(ParticleScalar) * 8 << "-bit" << endl;
+		return false;
+	}
+
+	// Check the sizes before touching any record, so a truncated file can't send us past the mapping
+	uint64_t maxItems = file.size() / sizeof(ParticleScalar);
+	if (header->particleCount > maxItems || header->vertexCount > maxItems)
+	{
+		cerr << "Snapshot " << path << " is truncated" << endl;
+		return false;
+	}
+	size_t recordsStart = sizeof(SnapshotHeader);
+	size_t verticesStart = recordsStart + header->particleCount * sizeof(SnapshotRecord);
+	if (verticesStart + header->vertexCount * 2 * sizeof(ParticleScalar) != file.size())
+	{
+		cerr << "Snapshot " << path << " does not match its header" << endl;
+		return false;
+	}
+
+	const SnapshotRecord* records = reinterpret_cast<const SnapshotRecord*>(file.data() + recordsStart);
+	const ParticleScalar* vertices = reinterpret_cast<const ParticleScalar*>(file.data() + verticesStart);
+
+	vector<Particle> restored;
+	restored.reserve(header->particleCount);
+	for (uint64_t i = 0; i < header->particleCount; i++)
+	{
+		const SnapshotRecord& record = records[i];
+		uint64_t n = (uint64_t)record.state.numPoints;
+		// written this way round so a huge vertexOffset from a damaged file cannot wrap past the check
+		if (record.state.numPoints < 1 || record.vertexOffset > header->vertexCount || n > header->vertexCount - record.vertexOffset)
+		{
+			cerr << "Snapshot " << path << " has a corrupt record " << i << endl;
+			return false;
+		}
+		const ParticleScalar* xs = vertices + 2 * record.vertexOffset;
+		restored.push_back(Particle(target, record.state, xs, xs + n));
+	}
+
+	particles.swap(restored);
+	params.gravity = header->gravity;
+	params.ttl = header->ttl;
+	params.scale = header->scale;
+	return true;
+}
+
+uint64_t hashState(const vector<Particle>& particles, const Parameters& params)
+{
+	uint64_t hash = fnv1a(FNV_OFFSET, &params, sizeof(params));
+	for (const Particle& particle : particles)
+	{
+		ParticleState state = particle.getState();
+		const VertexMatrix& A = particle.getVertices();
+		hash = fnv1a(hash, &state, sizeof(state));
+		hash = fnv1a(hash, A.row(0), A.getCols() * sizeof(ParticleScalar));
+		hash = fnv1a(hash, A.row(1), A.getCols() * sizeof(ParticleScalar));
+	}
+	return hash;
+}
@@ -1,11 +1,56 @@
 #include "Engine.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 
-int main()
+int main(int argc, char* argv[])
 {
+	// Read the command line options
+	//   --stdin          read control commands from standard input
+	//   --listen PATH    read control commands from a UNIX-domain socket
+	//   --budget MS      frame time budget for the governor, 0 turns it off
+	//   --load-snapshot PATH   restore the simulation from a snapshot at start-up
+	//   --save-snapshot PATH   save the simulation to a snapshot on exit
+	//   --record PATH          record the session to a replay log
+	//   --replay PATH          replay a log headless and print the final state hash
+	//   --headless FRAMES      run FRAMES frames without a window, then stop (0 to only load and save)
+	//   --export DIR           render every frame offscreen and write it to DIR
+	//   --export-format raw|ppm  one frames.rgba stream, or one .ppm per frame (the default)
+	EngineOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--stdin") == 0) options.listenStdin = true;
+		else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) options.socketPath = argv[++i];
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) options.frameBudgetMs = atof(argv[++i]);
+		else if (strcmp(argv[i], "--load-snapshot") == 0 && i + 1 < argc) options.loadSnapshotPath = argv[++i];
+		else if (strcmp(argv[i], "--save-snapshot") == 0 && i + 1 < argc) options.saveSnapshotPath = argv[++i];
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) options.recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) options.replayPath = argv[++i];
+		else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) options.headlessFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) options.exportDirectory = argv[++i];
+		else if (strcmp(argv[i], "--export-format") == 0 && i + 1 < argc && strcmp(argv[i + 1], "raw") == 0)
+		{
+			options.exportFormat = ExportFormat::Raw;
+			i++;
+		}
+		else if (strcmp(argv[i], "--export-format") == 0 && i + 1 < argc && strcmp(argv[i + 1], "ppm") == 0)
+		{
+			options.exportFormat = ExportFormat::PPM;
+			i++;
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--stdin] [--listen PATH] [--budget MS]"
+				<< " [--load-snapshot PATH] [--save-snapshot PATH]"
+				<< " [--record PATH] [--replay PATH] [--headless FRAMES] [--export DIR] [--export-format raw|ppm]" << endl;
+			return 1;
+		}
+	}
+
 	// Declare an instance of Engine
-	Engine engine;
+	Engine engine(options);
 	// Start the engine
 	engine.run();
 	// Quit in the usual way when the engine is stopped
 	return 0;
-}
\ No newline at end of file
+}